@@ -1,10 +1,10 @@
 #pragma once
 
 #include <stdx/container.h>
+#include <stdx/unique_function.h>
 
 #include <algorithm>
 #include <cstdint>
-#include <functional>
 #include <limits>
 #include <vector>
 
@@ -78,12 +78,12 @@ namespace detail
 template<typename FuncSig>
 struct Subscription
 {
-	Subscription( EventSinkSubscription& l, std::function<FuncSig> f, int32_t p )
+	Subscription( EventSinkSubscription& l, stdx::unique_function<FuncSig> f, int32_t p )
 		: listener{ &l }, function{ std::move( f ) }, priority{ p }
 	{}
 
 	EventSinkSubscription* listener;
-	std::function<FuncSig> function;
+	stdx::unique_function<FuncSig> function;
 	int32_t priority;
 
 	bool operator<( const Subscription& rhs ) const noexcept
@@ -107,13 +107,13 @@ struct ListenerPriority
 template <typename Func>
 inline auto operator%( EventSinkSubscription& listener, Func f ) noexcept
 {
-	return detail::Subscription{ listener, std::function( std::move( f ) ), static_cast<int32_t>( EventPriority::Medium ) };
+	return detail::Subscription{ listener, stdx::unique_function( std::move( f ) ), static_cast<int32_t>( EventPriority::Medium ) };
 }
 
 template <typename Func>
 inline auto operator%( detail::ListenerPriority&& temp, Func f ) noexcept
 {
-	return detail::Subscription{ temp.listener, std::function( std::move( f ) ), temp.priority };
+	return detail::Subscription{ temp.listener, stdx::unique_function( std::move( f ) ), temp.priority };
 }
 
 inline auto operator%( EventSinkSubscription& listener, EventPriority priority ) noexcept
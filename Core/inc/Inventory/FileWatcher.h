@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// reports watched files that were written or replaced. Uses inotify on Linux and polls modification times elsewhere.
+// The callback runs on the watcher's own thread with the filename as it was given to Watch()
+class FileWatcher
+{
+public:
+	using Callback = std::function<void( const std::string& filename )>;
+
+	// pollInterval is only used where change notifications are not supported
+	explicit FileWatcher( Callback onChanged, std::chrono::milliseconds pollInterval = std::chrono::milliseconds( 500 ) );
+
+	~FileWatcher();
+
+	FileWatcher( const FileWatcher& ) = delete;
+	FileWatcher& operator=( const FileWatcher& ) = delete;
+
+	// watching a file twice does nothing
+	void Watch( const std::string& filename );
+
+private:
+	struct State;
+
+	void Run();
+
+private:
+	Callback m_onChanged;
+	std::unique_ptr<State> m_state;
+	std::thread m_thread;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdx/assert.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using InventoryItemHash = uint32_t;
+
+// maps item hashes to entries, Entry must have a hash member. Find() is lock free, Insert() must be serialized by the owner.
+// Entries are never removed, so a pointer returned by Find() stays valid as long as the index
+template <typename Entry>
+class InventoryIndex
+{
+public:
+	InventoryIndex()
+	{
+		m_table.store( AddTable( InitialCapacity ), std::memory_order_relaxed );
+	}
+
+	InventoryIndex( const InventoryIndex& ) = delete;
+	InventoryIndex& operator=( const InventoryIndex& ) = delete;
+
+	// may miss an entry inserted concurrently. Look again under the owner's lock before inserting
+	Entry* Find( InventoryItemHash hash ) const noexcept
+	{
+		const Table* table = m_table.load( std::memory_order_acquire );
+		for ( size_t i = hash & table->mask;; i = ( i + 1 ) & table->mask )
+		{
+			Entry* entry = table->slots[ i ].load( std::memory_order_acquire );
+			if ( entry == nullptr || entry->hash == hash )
+				return entry;
+		}
+	}
+
+	Entry* Insert( std::unique_ptr<Entry> entry )
+	{
+		dbAssert( Find( entry->hash ) == nullptr );
+
+		Table* table = m_table.load( std::memory_order_relaxed );
+
+		// keep at most half the slots full so probes stay short
+		if ( ( m_entries.size() + 1 ) * 2 > table->mask + 1 )
+		{
+			Table* grown = AddTable( ( table->mask + 1 ) * 2 );
+			for ( auto& existing : m_entries )
+				Place( *grown, existing.get() );
+
+			// readers still in the old table only miss new entries, which sends them to the locked path
+			m_table.store( grown, std::memory_order_release );
+			table = grown;
+		}
+
+		Entry* result = entry.get();
+		m_entries.push_back( std::move( entry ) );
+		Place( *table, result );
+		return result;
+	}
+
+	size_t GetSize() const noexcept
+	{
+		return m_entries.size();
+	}
+
+	// must be serialized with Insert() by the owner
+	template <typename Function>
+	void ForEach( Function&& f ) const
+	{
+		for ( auto& entry : m_entries )
+			f( *entry );
+	}
+
+private:
+	static constexpr size_t InitialCapacity = 64;
+
+	struct Table
+	{
+		size_t mask;
+		std::unique_ptr<std::atomic<Entry*>[]> slots;
+	};
+
+	Table* AddTable( size_t capacity )
+	{
+		auto table = std::make_unique<Table>();
+		table->mask = capacity - 1;
+		table->slots = std::make_unique<std::atomic<Entry*>[]>( capacity );
+		for ( size_t i = 0; i < capacity; ++i )
+			table->slots[ i ].store( nullptr, std::memory_order_relaxed );
+
+		// outgrown tables are kept until the index is destroyed since lookups may still be reading them
+		m_tables.push_back( std::move( table ) );
+		return m_tables.back().get();
+	}
+
+	static void Place( Table& table, Entry* entry ) noexcept
+	{
+		size_t i = entry->hash & table.mask;
+		while ( table.slots[ i ].load( std::memory_order_relaxed ) != nullptr )
+			i = ( i + 1 ) & table.mask;
+
+		table.slots[ i ].store( entry, std::memory_order_release );
+	}
+
+private:
+	std::atomic<Table*> m_table;
+	std::vector<std::unique_ptr<Table>> m_tables;
+	std::vector<std::unique_ptr<Entry>> m_entries;
+};
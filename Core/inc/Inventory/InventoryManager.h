@@ -1,17 +1,28 @@
 #pragma once
 
+#include "FileWatcher.h"
+#include "InventoryIndex.h"
+#include "InventoryPack.h"
+
+#include "EventSink.h"
 #include "Threading/Future.h"
+#include "Threading/QueuedExecutor.h"
 #include "Threading/ThreadPool.h"
+#include "Threading/ThreadPoolRegistry.h"
 
-#include <stdx/flat_map.h>
 #include <stdx/reflection.h>
 #include <stdx/type_traits.h>
 #include <stdx/utility.h>
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
+#include <limits>
+#include <list>
 #include <mutex>
+#include <optional>
 #include <string>
-#include <typeindex>
+#include <vector>
 
 // forward declarations
 
@@ -22,6 +33,29 @@ T LoadInventoryItem( std::string_view filename )
 	static_assert( "LoadInventoryItem() is not implemented for this type" );
 }
 
+// must implement this function for types that set InventoryLoadsFromPack. Loads the item in place from a mounted pack.
+// Packs stay mapped as long as the manager, so items may keep pointers into the bytes
+template <typename T>
+T LoadInventoryItem( std::string_view filename, InventoryBytes bytes )
+{
+	static_assert( "LoadInventoryItem() from a pack is not implemented for this type" );
+}
+
+// specialize to std::true_type for types that implement LoadInventoryItem( filename, InventoryBytes ).
+// Other types always load from their own files, even if a mounted pack holds them
+template <typename T>
+struct InventoryLoadsFromPack : std::false_type {};
+
+template <typename T>
+inline constexpr bool InventoryLoadsFromPack_v = InventoryLoadsFromPack<T>::value;
+
+// may be specialized to report the memory an item holds for the residency budgets. Defaults to sizeof( T )
+template <typename T>
+size_t InventorySizeOf( const T& )
+{
+	return sizeof( T );
+}
+
 template <typename T>
 struct InventoryEntry;
 
@@ -33,32 +67,101 @@ class InventoryBucket;
 
 class InventoryManager;
 
+class InventoryManifest;
+
 // Types
 
-using InventoryItemHash = uint32_t;
+// sort key for batched reads, e.g. the offset of the item on disk. Without one, batches of types that load from packs
+// are read in the order of the mounted packs, then loose files in filename order
+using InventoryReadOrder = std::function<uint64_t( std::string_view filename )>;
 
 enum class LoadState
 {
+	Unloaded,
 	Loading,
 	Ready
 };
 
+struct InventoryCacheStats
+{
+	// requests for items that were loaded, cold or still loading
+	uint64_t hits = 0;
+
+	// requests that had to load from disk
+	uint64_t misses = 0;
+
+	uint64_t evictions = 0;
+
+	// items replaced by hot reload
+	uint64_t reloads = 0;
+
+	// every loaded item, referenced or not
+	size_t residentBytes = 0;
+
+	// loaded items without handles, waiting to be evicted
+	size_t coldBytes = 0;
+	size_t coldCount = 0;
+
+	InventoryCacheStats& operator+=( const InventoryCacheStats& other ) noexcept
+	{
+		hits += other.hits;
+		misses += other.misses;
+		evictions += other.evictions;
+		reloads += other.reloads;
+		residentBytes += other.residentBytes;
+		coldBytes += other.coldBytes;
+		coldCount += other.coldCount;
+		return *this;
+	}
+};
+
 template <typename T>
 struct InventoryEntry
 {
 	using Handle = InventoryHandle<T>;
 
-	T item;
-	mutable std::mutex mutex;
+	// entries live as long as their bucket so lookups never need a lock. Eviction only destroys the item
+	std::unique_ptr<T> item;
+
+	// what handles read. Hot reload swaps in a new version and keeps the old ones, oldest first, until no handle is
+	// left or more than MaxRetired have piled up
+	static constexpr size_t MaxRetired = 2;
+	std::atomic<const T*> current = nullptr;
+	std::vector<std::unique_ptr<T>> retired;
+	bool reloading = false;
+
+	// loaded from a mounted pack, which never changes, so hot reload leaves it alone
+	bool packed = false;
+
 	mutable std::atomic<uint32_t> refCount = 0;
 	std::string filename;
 	InventoryItemHash hash = 0;
-	LoadState state = LoadState::Loading;
+
+	// guarded by the bucket
+	LoadState state = LoadState::Unloaded;
 	Threading::SharedFuture<Handle> future;
 
+	// residency, guarded by the bucket. Unreferenced entries sit on the bucket's cold list until a budget needs the memory
+	size_t size = 0;
+	bool cold = false;
+	uint64_t coldTick = 0;
+	typename std::list<InventoryEntry*>::iterator coldPosition;
+
 	InventoryEntry( std::string filename_, InventoryItemHash hash_ )
 		: filename( std::move( filename_ ) ), hash( hash_ )
 	{}
+
+	// only succeeds while somebody else holds a reference, which keeps the item loaded
+	bool TryAddRef() const noexcept
+	{
+		uint32_t count = refCount.load( std::memory_order_relaxed );
+		while ( count != 0 )
+		{
+			if ( refCount.compare_exchange_weak( count, count + 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+				return true;
+		}
+		return false;
+	}
 };
 
 template <typename T>
@@ -111,9 +214,11 @@ public:
 		return *this;
 	}
 
+	// may return a newer version after a hot reload. A pointer stays valid while any handle to the item exists, but
+	// only for InventoryEntry<T>::MaxRetired reloads after it was replaced. Read through the handle again after a reload
 	const T* Get() const noexcept
 	{
-		return std::addressof( m_entry->item );
+		return m_entry->current.load( std::memory_order_acquire );
 	}
 
 	const T* operator->() const noexcept
@@ -125,7 +230,7 @@ public:
 	const T& operator*() const noexcept
 	{
 		dbAssert( m_entry );
-		return m_entry->item;
+		return *Get();
 	}
 
 	bool Valid() const noexcept
@@ -142,6 +247,12 @@ private:
 		++( m_entry->refCount );
 	}
 
+	// takes over a reference the caller already added
+	InventoryHandle( const InventoryEntry<T>* entry, std::adopt_lock_t ) noexcept : m_entry{ entry }
+	{
+		dbAssert( m_entry );
+	}
+
 private:
 	const InventoryEntry<T>* m_entry = nullptr;
 };
@@ -150,6 +261,26 @@ class BaseInventoryBucket
 {
 public:
 	virtual ~BaseInventoryBucket() = default;
+
+	// release order of the least recently used cold entry, shared by all buckets so they can be evicted oldest first
+	virtual std::optional<uint64_t> GetOldestColdTick() = 0;
+
+	// returns the bytes freed, zero if nothing was cold
+	virtual size_t EvictOldest() = 0;
+
+	virtual InventoryCacheStats GetStats() = 0;
+
+	// evicts the item if nobody holds it, otherwise reloads it in the background
+	virtual void OnFileChanged( const std::string& filename, const Threading::QueuedExecutor& events ) = 0;
+
+	virtual void WatchLoaded( FileWatcher& watcher ) = 0;
+
+protected:
+	static uint64_t NextColdTick() noexcept
+	{
+		static std::atomic<uint64_t> s_tick = 0;
+		return ++s_tick;
+	}
 };
 
 template <typename T>
@@ -161,15 +292,281 @@ public:
 	using Entry = InventoryEntry<T>;
 	using Handle = InventoryHandle<T>;
 
+	// the totals and the budget are the manager's, shared by every bucket
+	InventoryBucket( std::atomic<size_t>& totalResidentBytes, std::atomic<size_t>& totalColdBytes, const std::atomic<size_t>& totalBudget )
+		: m_totalResidentBytes( totalResidentBytes )
+		, m_totalColdBytes( totalColdBytes )
+		, m_totalBudget( totalBudget )
+	{}
+
 	Handle LoadSync( std::string_view filename );
 
 	Threading::SharedFuture<Handle> LoadAsync( std::string_view filename );
 
-	void UnloadSync( const Entry* entry );
+	// starts loading every item that is not loaded or loading yet, as one batch in read order.
+	// Returns a future per filename, in the same order
+	std::vector<Threading::SharedFuture<Handle>> Prefetch( const std::vector<std::string_view>& filenames, Threading::Priority priority, const InventoryReadOrder& readOrder );
+
+	// called once the last handle is gone. The entry goes cold and stays loaded until a budget needs the memory.
+	// The manager's budget is met from this bucket's cold entries first, so a release only locks this bucket
+	void Release( InventoryItemHash hash );
+
+	// cold entries of this type are evicted while its loaded items take more than this. Unlimited by default
+	void SetBudget( size_t bytes );
+
+	std::optional<uint64_t> GetOldestColdTick() override;
+
+	size_t EvictOldest() override;
+
+	InventoryCacheStats GetStats() override;
+
+	void OnFileChanged( const std::string& filename, const Threading::QueuedExecutor& events ) override;
+
+	void WatchLoaded( FileWatcher& watcher ) override;
+
+	// fired with the new version after a hot reload
+	EventSink<void, const Handle&>& GetReloadedEvent() noexcept
+	{
+		return m_reloaded;
+	}
+
+private:
+	// evicted items are destroyed after unlocking since items may hold handles to other items
+	using Evicted = std::vector<std::unique_ptr<T>>;
+
+	// lock free lookup of an item somebody else holds. Returns an empty handle if the bucket has to be locked
+	Handle TryAcquire( InventoryItemHash hash, std::string_view filename );
+
+	Entry* FindOrInsert( InventoryItemHash hash, std::string_view filename );
+
+	// loads an entry without holding the bucket, since loaders may load other items
+	Handle FinishLoad( Entry* entry );
+
+	void Reload( Handle handle, Threading::QueuedExecutor events );
+
+	void MakeResident( Entry& entry, Evicted& evicted );
+	// frees the oldest retired versions until at most keep are left
+	void DropRetired( Entry& entry, size_t keep, Evicted& evicted );
+	void Revive( Entry& entry );
+	size_t Evict( Entry& entry, Evicted& evicted );
+	void TrimToBudget( Evicted& evicted );
 
 private:
-	stdx::flat_map<InventoryItemHash, std::unique_ptr<Entry>> m_items;
+	InventoryIndex<Entry> m_index;
 	std::mutex m_mutex;
+
+	// least recently released at the front
+	std::list<Entry*> m_cold;
+
+	std::atomic<size_t>& m_totalResidentBytes;
+	std::atomic<size_t>& m_totalColdBytes;
+	const std::atomic<size_t>& m_totalBudget;
+	size_t m_budget = std::numeric_limits<size_t>::max();
+	InventoryCacheStats m_stats;
+	std::atomic<uint64_t> m_lockFreeHits = 0;
+
+	EventSink<void, const Handle&> m_reloaded;
+};
+
+class InventoryManager
+{
+public:
+	static InventoryManager* Get()
+	{
+		static InventoryManager s_instance;
+		return &s_instance;
+	}
+
+	template <typename T>
+	InventoryHandle<T> LoadSync( std::string_view filename )
+	{
+		return GetBucket<T>()->LoadSync( filename );
+	}
+
+	template <typename T>
+	Threading::SharedFuture<InventoryHandle<T>> LoadAsync( std::string_view filename )
+	{
+		return GetBucket<T>()->LoadAsync( filename );
+	}
+
+	// loads a batch of items of one type. Items already loaded or loading are not read again, the rest are queued on the
+	// IO pool at the given priority, sorted by the read order. The future holds a handle per filename, in the same order
+	template <typename T, typename Range>
+	Threading::Future<std::vector<InventoryHandle<T>>> Prefetch( const Range& filenames, Threading::Priority priority = Threading::Priority::Medium )
+	{
+		std::vector<std::string_view> names;
+		for ( const auto& filename : filenames )
+			names.push_back( filename );
+
+		return Threading::WhenAll( GetBucket<T>()->Prefetch( names, priority, GetReadOrder( InventoryLoadsFromPack_v<T> ) ) );
+	}
+
+	// loads every item in the manifest and keeps them loaded until the manifest is unloaded.
+	// Loading a name again replaces the previous manifest once the new one has been requested, so shared items are not reloaded
+	Threading::Future<void> LoadManifest( std::string name, const InventoryManifest& manifest, Threading::Priority priority = Threading::Priority::Medium );
+
+	// lets go of the manifest's items. They go cold and are evicted as the budgets require
+	void UnloadManifest( std::string_view name );
+
+	bool IsManifestLoaded( std::string_view name );
+
+	// watches the files of loaded items and reloads changed ones on the background pool. Handles switch to the new
+	// version once it is loaded, so reading a handle never waits on a reload. Reload events are posted to events
+	// and fire on the thread that drains it
+	void EnableHotReload( Threading::QueuedExecutor events );
+
+	void DisableHotReload();
+
+	bool IsHotReloadEnabled() const noexcept
+	{
+		return m_hotReload;
+	}
+
+	// only subscribe from the thread that drains the hot reload events
+	template <typename T>
+	EventSink<void, const InventoryHandle<T>&>& GetReloadedEvent()
+	{
+		return GetBucket<T>()->GetReloadedEvent();
+	}
+
+	// maps a pack built by BuildInventoryPack(). Items of types that set InventoryLoadsFromPack load from it in place
+	// instead of from their own files, and packs mounted later take precedence. Packs stay mapped as long as the manager
+	bool MountPack( const std::string& filename );
+
+	void SetReadOrder( InventoryReadOrder readOrder )
+	{
+		std::lock_guard lock( m_mutex );
+		m_readOrder = std::move( readOrder );
+	}
+
+	// trimming other buckets locks all of them, so a release only does it once their cold items leave the total
+	// over budget by a margin
+	template <typename T>
+	void Release( InventoryItemHash hash )
+	{
+		GetBucket<T>()->Release( hash );
+
+		const size_t budget = m_budget;
+		const size_t resident = m_residentBytes;
+		if ( m_coldBytes > 0 && resident > budget && resident - budget > budget / TrimMarginDivisor )
+			TrimToBudget();
+	}
+
+	// cold items are evicted, least recently released first across all types, while loaded items take more than this.
+	// A release evicts cold items of its own type first. Zero ( the default ) evicts items as soon as their last handle
+	// goes away
+	void SetBudget( size_t bytes )
+	{
+		m_budget = bytes;
+		TrimToBudget();
+	}
+
+	size_t GetBudget() const noexcept
+	{
+		return m_budget;
+	}
+
+	template <typename T>
+	void SetBucketBudget( size_t bytes )
+	{
+		GetBucket<T>()->SetBudget( bytes );
+	}
+
+	template <typename T>
+	InventoryCacheStats GetStats()
+	{
+		return GetBucket<T>()->GetStats();
+	}
+
+	InventoryCacheStats GetStats();
+
+	void TrimToBudget();
+
+private:
+	template <typename T>
+	friend class InventoryBucket;
+
+	InventoryManager() = default;
+	InventoryManager( const InventoryManager& ) = delete;
+
+	void WatchFile( const std::string& filename );
+
+	void OnFileChanged( const std::string& filename );
+
+	template <typename T>
+	InventoryBucket<T>* GetBucket();
+
+	template <typename T>
+	InventoryBucket<T>* AddBucket();
+
+	std::optional<InventoryBytes> FindInPacks( std::string_view filename );
+
+	// pack offsets only order types that load from packs
+	InventoryReadOrder GetReadOrder( bool fromPacks );
+
+private:
+	// keeps a loaded manifest's handles, type erased
+	struct LoadedManifest
+	{
+		std::string name;
+		Threading::SharedFuture<std::vector<std::shared_ptr<void>>> handles;
+	};
+
+	// only touched when a type is first used and when trimming or gathering stats
+	std::vector<std::unique_ptr<BaseInventoryBucket>> m_buckets;
+	std::mutex m_mutex;
+
+	InventoryReadOrder m_readOrder;
+
+	// never unmounted, since items may point into them
+	std::vector<std::unique_ptr<InventoryPack>> m_packs;
+
+	// separate from m_mutex since replacing a manifest releases handles, which may trim
+	std::vector<LoadedManifest> m_manifests;
+	std::mutex m_manifestMutex;
+
+	static constexpr size_t TrimMarginDivisor = 16;
+
+	std::atomic<size_t> m_residentBytes = 0;
+	std::atomic<size_t> m_coldBytes = 0;
+	std::atomic<size_t> m_budget = 0;
+
+	std::atomic<bool> m_hotReload = false;
+	std::optional<Threading::QueuedExecutor> m_reloadEvents;
+
+	// declared last so its thread stops before anything it calls into is destroyed
+	std::unique_ptr<FileWatcher> m_watcher;
+};
+
+// a list of items to load and unload together, e.g. everything a level needs.
+// Items are grouped by type so each type is prefetched as one batch
+class InventoryManifest
+{
+public:
+	template <typename T>
+	InventoryManifest& Add( std::string filename );
+
+	bool Empty() const noexcept
+	{
+		return m_groups.empty();
+	}
+
+private:
+	friend class InventoryManager;
+
+	using HeldHandles = std::shared_ptr<void>;
+	using PrefetchFunction = Threading::Future<HeldHandles>( * )( const std::vector<std::string>& filenames, Threading::Priority priority );
+
+	template <typename T>
+	static Threading::Future<HeldHandles> PrefetchGroup( const std::vector<std::string>& filenames, Threading::Priority priority );
+
+	struct Group
+	{
+		PrefetchFunction prefetch;
+		std::vector<std::string> filenames;
+	};
+
+	std::vector<Group> m_groups;
 };
 
 template <typename T>
@@ -177,36 +574,42 @@ InventoryHandle<T> InventoryBucket<T>::LoadSync( std::string_view filename )
 {
 	const auto hash = stdx::hash_fnv1a<InventoryItemHash>( filename );
 
-	std::lock_guard lock( m_mutex );
+	if ( auto handle = TryAcquire( hash, filename ); handle.Valid() )
+		return handle;
 
-	auto it = m_items.find( hash );
-	if ( it == m_items.end() )
+	std::unique_lock lock( m_mutex );
+
+	auto* entry = FindOrInsert( hash, filename );
+	if ( entry->state == LoadState::Unloaded )
 	{
 		// load item
 		dbLog( "InventoryBucket<%s>::LoadSync( %s )", stdx::reflection::type_name_v<T>.c_str(), filename.data() );
-		auto[ pos, inserted ] = m_items.insert( { hash, std::make_unique<Entry>( std::string( filename ), hash ) } );
-		dbAssert( inserted );
-		auto* entry = pos->second.get();
-		entry->item = LoadInventoryItem<T>( filename );
-		entry->state = LoadState::Ready;
-		return Handle( entry );
+		++m_stats.misses;
+
+		// other threads asking for the item meanwhile wait on the future like an async load
+		auto[ future, promise ] = Threading::MakeSharedFuturePromisePair<Handle>();
+		entry->future = future;
+		entry->state = LoadState::Loading;
+		lock.unlock();
+
+		Threading::Detail::InvokeContinuation( std::move( promise ), [ this, entry ] { return FinishLoad( entry ); } );
+		return std::move( future ).Get();
+	}
+
+	++m_stats.hits;
+	if ( entry->state == LoadState::Loading )
+	{
+		dbLogWarning( "LoadSync called on entry which is loading asynchronously" );
+		auto future = entry->future;
+
+		// the loader needs the bucket to finish
+		lock.unlock();
+		return std::move( future ).Get();
 	}
 	else
 	{
-		dbAssertMessage( it->second->filename == filename, "detected hash collision [%s] [%s]", filename.data(), it->second->filename.c_str() );
-		auto* entry = it->second.get();
-		std::unique_lock entryLock( entry->mutex );
-		if ( entry->state == LoadState::Loading )
-		{
-			dbLogWarning( "LoadSync called on entry which is loading asynchronously" );
-			auto future = entry->future;
-			entryLock.unlock();
-			return std::move( future ).Get();
-		}
-		else
-		{
-			return Handle( entry );
-		}
+		Revive( *entry );
+		return Handle( entry );
 	}
 }
 
@@ -215,106 +618,665 @@ Threading::SharedFuture<InventoryHandle<T>> InventoryBucket<T>::LoadAsync( std::
 {
 	const auto hash = stdx::hash_fnv1a<InventoryItemHash>( filename );
 
+	if ( auto handle = TryAcquire( hash, filename ); handle.Valid() )
+		return Threading::MakeReadySharedFuture<Handle>( std::move( handle ) );
+
 	std::lock_guard lock( m_mutex );
 
-	auto it = m_items.find( hash );
-	if ( it == m_items.end() )
+	auto* entry = FindOrInsert( hash, filename );
+	if ( entry->state == LoadState::Unloaded )
 	{
 		// load async
-		dbLog( "InventoryBucket<%s>::LoadSync( %s )", stdx::reflection::type_name_v<T>.c_str(), filename.data() );
-		auto[ pos, inserted ] = m_items.insert( { hash, std::make_unique<Entry>( std::string( filename ), hash ) } );
-		dbAssert( inserted );
-		auto* entry = pos->second.get();
+		dbLog( "InventoryBucket<%s>::LoadAsync( %s )", stdx::reflection::type_name_v<T>.c_str(), filename.data() );
+		++m_stats.misses;
 
 		auto[ future, promise ] = Threading::MakeSharedFuturePromisePair<Handle>();
+		entry->future = future;
+		entry->state = LoadState::Loading;
 
-		Threading::Execute( Threading::ConcurrentExecutor(), Threading::Task<Handle, void>( [entry]
-			{
-				auto item = LoadInventoryItem<T>( filename );
-				std::lock_guard lock( entry->mutex );
-				entry->item = std::move( item );
-				entry->state = LoadState::Ready;
-				entry->future.Discard();
-				return Handle( entry );
-			}, std::move( promise ) ) );
+		// loading blocks on the file system, so keep it off the compute workers
+		Threading::Execute( Threading::IOExecutor(), Threading::Detail::Task( std::move( promise ), [ this, entry ] { return FinishLoad( entry ); } ) );
 
 		return std::move( future );
 	}
+
+	++m_stats.hits;
+	if ( entry->state == LoadState::Ready )
+	{
+		Revive( *entry );
+		return Threading::MakeReadySharedFuture<Handle>( Handle( entry ) );
+	}
 	else
 	{
-		dbAssertMessage( it->second->filename == filename, "detected hash collision [%s] [%s]", filename.data(), it->second->filename.c_str() );
-		auto* entry = it->second;
-		std::lock_guard entryLock( entry->mutex );
-		if ( entry->state == LoadState::Ready )
-			return Threading::MakeReadySharedFuture( Handle( it->second.get() ) );
+		return entry->future;
+	}
+}
+
+template <typename T>
+std::vector<Threading::SharedFuture<InventoryHandle<T>>> InventoryBucket<T>::Prefetch( const std::vector<std::string_view>& filenames, Threading::Priority priority, const InventoryReadOrder& readOrder )
+{
+	struct PendingLoad
+	{
+		uint64_t order;
+		Entry* entry;
+		Threading::Promise<Handle> promise;
+	};
+
+	std::vector<Threading::SharedFuture<Handle>> futures;
+	futures.reserve( filenames.size() );
+	std::vector<PendingLoad> loads;
+	{
+		std::lock_guard lock( m_mutex );
+		for ( auto filename : filenames )
+		{
+			// repeats within the batch find the entry loading and share its future
+			auto* entry = FindOrInsert( stdx::hash_fnv1a<InventoryItemHash>( filename ), filename );
+			if ( entry->state == LoadState::Unloaded )
+			{
+				++m_stats.misses;
+				auto[ future, promise ] = Threading::MakeSharedFuturePromisePair<Handle>();
+				entry->future = future;
+				entry->state = LoadState::Loading;
+				loads.push_back( PendingLoad{ 0, entry, std::move( promise ) } );
+				futures.push_back( std::move( future ) );
+			}
+			else
+			{
+				++m_stats.hits;
+				if ( entry->state == LoadState::Ready )
+				{
+					Revive( *entry );
+					futures.push_back( Threading::MakeReadySharedFuture<Handle>( Handle( entry ) ) );
+				}
+				else
+				{
+					futures.push_back( entry->future );
+				}
+			}
+		}
+	}
+
+	if ( loads.empty() )
+		return futures;
+
+	dbLog( "InventoryBucket<%s>::Prefetch() loading %zu items", stdx::reflection::type_name_v<T>.c_str(), loads.size() );
+
+	if ( readOrder )
+	{
+		for ( auto& load : loads )
+			load.order = readOrder( load.entry->filename );
+	}
+
+	std::sort( loads.begin(), loads.end(), []( const PendingLoad& lhs, const PendingLoad& rhs )
+		{
+			if ( lhs.order != rhs.order )
+				return lhs.order < rhs.order;
+
+			return lhs.entry->filename < rhs.entry->filename;
+		} );
+
+	// queued together so the IO workers pick them up in read order
+	std::vector<Threading::ThreadPool::Task> tasks;
+	tasks.reserve( loads.size() );
+	for ( auto& load : loads )
+		tasks.emplace_back( Threading::Detail::Task( std::move( load.promise ), [ this, entry = load.entry ] { return FinishLoad( entry ); } ) );
+
+	Threading::ThreadPoolRegistry::Get()->GetPool( Threading::StandardPool::IO ).QueueTasks( tasks.data(), tasks.size(), priority );
+	return futures;
+}
+
+template <typename T>
+InventoryHandle<T> InventoryBucket<T>::TryAcquire( InventoryItemHash hash, std::string_view filename )
+{
+	const Entry* entry = m_index.Find( hash );
+	if ( entry == nullptr || !entry->TryAddRef() )
+		return Handle();
+
+	dbAssertMessage( entry->filename == filename, "detected hash collision [%s] [%s]", filename.data(), entry->filename.c_str() );
+	m_lockFreeHits.fetch_add( 1, std::memory_order_relaxed );
+	return Handle( entry, std::adopt_lock );
+}
+
+template <typename T>
+InventoryEntry<T>* InventoryBucket<T>::FindOrInsert( InventoryItemHash hash, std::string_view filename )
+{
+	if ( auto* entry = m_index.Find( hash ) )
+	{
+		dbAssertMessage( entry->filename == filename, "detected hash collision [%s] [%s]", filename.data(), entry->filename.c_str() );
+		return entry;
+	}
+
+	return m_index.Insert( std::make_unique<Entry>( std::string( filename ), hash ) );
+}
+
+template <typename T>
+InventoryHandle<T> InventoryBucket<T>::FinishLoad( Entry* entry )
+{
+	std::optional<InventoryBytes> bytes;
+	if constexpr ( InventoryLoadsFromPack_v<T> )
+		bytes = InventoryManager::Get()->FindInPacks( entry->filename );
+
+	std::unique_ptr<T> item;
+	try
+	{
+		if constexpr ( InventoryLoadsFromPack_v<T> )
+			item = bytes ? std::make_unique<T>( LoadInventoryItem<T>( entry->filename, *bytes ) ) : std::make_unique<T>( LoadInventoryItem<T>( entry->filename ) );
 		else
-			return entry->future;
+			item = std::make_unique<T>( LoadInventoryItem<T>( entry->filename ) );
+	}
+	catch ( ... )
+	{
+		// waiters get the error through the future, later requests try again
+		std::lock_guard lock( m_mutex );
+		entry->state = LoadState::Unloaded;
+		entry->future.Discard();
+		throw;
+	}
+
+	Handle handle;
+	Evicted evicted;
+	{
+		std::lock_guard lock( m_mutex );
+		entry->item = std::move( item );
+		entry->current.store( entry->item.get(), std::memory_order_release );
+		entry->packed = bytes.has_value();
+		entry->state = LoadState::Ready;
+		entry->future.Discard();
+		MakeResident( *entry, evicted );
+		handle = Handle( entry );
+	}
+	evicted.clear();
+
+	if ( !bytes )
+		InventoryManager::Get()->WatchFile( entry->filename );
+
+	InventoryManager::Get()->TrimToBudget();
+	return handle;
+}
+
+template <typename T>
+void InventoryBucket<T>::Release( InventoryItemHash hash )
+{
+	Evicted evicted;
+	std::lock_guard lock( m_mutex );
+
+	// the entry may have been reloaded, released again and evicted since the handle let go of it
+	auto* found = m_index.Find( hash );
+	if ( found == nullptr )
+		return;
+
+	auto& entry = *found;
+	if ( entry.refCount != 0 || entry.cold || entry.state != LoadState::Ready )
+	{
+		dbLog( "inventory entry avoided release [%s]", entry.filename.c_str() );
+		return;
 	}
+
+	// no handle is left to read an older version
+	DropRetired( entry, 0, evicted );
+
+	entry.cold = true;
+	entry.coldTick = NextColdTick();
+	entry.coldPosition = m_cold.insert( m_cold.end(), &entry );
+	m_stats.coldBytes += entry.size;
+	m_totalColdBytes += entry.size;
+
+	TrimToBudget( evicted );
+
+	// this bucket's own least recently released entries go first, without touching the other buckets
+	while ( m_totalResidentBytes > m_totalBudget && !m_cold.empty() )
+		Evict( *m_cold.front(), evicted );
 }
 
 template <typename T>
-void InventoryBucket<T>::UnloadSync( const Entry* entry )
+void InventoryBucket<T>::SetBudget( size_t bytes )
 {
-	dbAssert( entry );
-	dbLog( "InventoryBucket<%s>::UnloadSync()", stdx::reflection::type_name_v<T>.c_str() );
+	Evicted evicted;
+	std::lock_guard lock( m_mutex );
+	m_budget = bytes;
+	TrimToBudget( evicted );
+}
 
+template <typename T>
+std::optional<uint64_t> InventoryBucket<T>::GetOldestColdTick()
+{
 	std::lock_guard lock( m_mutex );
+	if ( m_cold.empty() )
+		return std::nullopt;
 
-	// we may have tried to load this asset between Handle::Reset() and now
-	if ( entry->refCount == 0 )
-		m_items.erase( entry->hash );
-	else
-		dbLog( "inventory entry avoided unload [%s]", entry->filename.c_str() );
+	return m_cold.front()->coldTick;
 }
 
-class InventoryManager
+template <typename T>
+size_t InventoryBucket<T>::EvictOldest()
 {
-public:
-	static InventoryManager* Get()
+	Evicted evicted;
+	std::lock_guard lock( m_mutex );
+	return m_cold.empty() ? 0 : Evict( *m_cold.front(), evicted );
+}
+
+template <typename T>
+InventoryCacheStats InventoryBucket<T>::GetStats()
+{
+	std::lock_guard lock( m_mutex );
+	InventoryCacheStats stats = m_stats;
+	stats.hits += m_lockFreeHits.load( std::memory_order_relaxed );
+	stats.coldCount = m_cold.size();
+	return stats;
+}
+
+template <typename T>
+void InventoryBucket<T>::MakeResident( Entry& entry, Evicted& evicted )
+{
+	entry.size = InventorySizeOf<T>( *entry.item );
+	m_stats.residentBytes += entry.size;
+	m_totalResidentBytes += entry.size;
+	TrimToBudget( evicted );
+}
+
+template <typename T>
+void InventoryBucket<T>::DropRetired( Entry& entry, size_t keep, Evicted& evicted )
+{
+	if ( entry.retired.size() <= keep )
+		return;
+
+	const auto last = entry.retired.end() - keep;
+	for ( auto it = entry.retired.begin(); it != last; ++it )
 	{
-		static InventoryManager s_instance;
-		return &s_instance;
+		const size_t size = InventorySizeOf<T>( **it );
+		entry.size -= size;
+		m_stats.residentBytes -= size;
+		m_totalResidentBytes -= size;
+		evicted.push_back( std::move( *it ) );
 	}
+	entry.retired.erase( entry.retired.begin(), last );
+}
 
-	template <typename T>
-	InventoryHandle<T> LoadSync( std::string_view filename )
+template <typename T>
+void InventoryBucket<T>::Revive( Entry& entry )
+{
+	if ( !entry.cold )
+		return;
+
+	m_cold.erase( entry.coldPosition );
+	entry.cold = false;
+	m_stats.coldBytes -= entry.size;
+	m_totalColdBytes -= entry.size;
+}
+
+template <typename T>
+size_t InventoryBucket<T>::Evict( Entry& entry, Evicted& evicted )
+{
+	dbAssert( entry.cold && entry.refCount == 0 );
+	dbLog( "InventoryBucket<%s>::Evict( %s )", stdx::reflection::type_name_v<T>.c_str(), entry.filename.c_str() );
+
+	const size_t size = entry.size;
+	m_cold.erase( entry.coldPosition );
+	entry.cold = false;
+	entry.size = 0;
+	m_stats.coldBytes -= size;
+	m_stats.residentBytes -= size;
+	m_totalColdBytes -= size;
+	m_totalResidentBytes -= size;
+	++m_stats.evictions;
+
+	entry.current.store( nullptr, std::memory_order_relaxed );
+	evicted.push_back( std::move( entry.item ) );
+	for ( auto& item : entry.retired )
+		evicted.push_back( std::move( item ) );
+
+	entry.retired.clear();
+	entry.state = LoadState::Unloaded;
+	return size;
+}
+
+template <typename T>
+void InventoryBucket<T>::TrimToBudget( Evicted& evicted )
+{
+	while ( m_stats.residentBytes > m_budget && !m_cold.empty() )
+		Evict( *m_cold.front(), evicted );
+}
+
+template <typename T>
+void InventoryBucket<T>::OnFileChanged( const std::string& filename, const Threading::QueuedExecutor& events )
+{
+	Handle handle;
+	Evicted evicted;
 	{
-		return GetBucket<T>()->LoadSync( filename );
+		std::lock_guard lock( m_mutex );
+
+		auto* entry = m_index.Find( stdx::hash_fnv1a<InventoryItemHash>( filename ) );
+		if ( entry == nullptr || entry->filename != filename || entry->state != LoadState::Ready || entry->reloading )
+			return;
+
+		if ( entry->cold )
+		{
+			// nobody holds it, so the next load reads the new file
+			Evict( *entry, evicted );
+			return;
+		}
+
+		// the handle keeps the entry loaded until the reload is published
+		entry->reloading = true;
+		handle = Handle( entry );
 	}
 
-	template <typename T>
-	void UnloadSync( const InventoryEntry<T>* entry )
+	Threading::Execute( Threading::BackgroundExecutor(), [ this, handle = std::move( handle ), events ]() mutable
+		{
+			Reload( std::move( handle ), std::move( events ) );
+		} );
+}
+
+template <typename T>
+void InventoryBucket<T>::Reload( Handle handle, Threading::QueuedExecutor events )
+{
+	auto* entry = m_index.Find( handle.m_entry->hash );
+
+	std::unique_ptr<T> item;
+	try
 	{
-		GetBucket<T>()->UnloadSync( entry );
+		item = std::make_unique<T>( LoadInventoryItem<T>( entry->filename ) );
+	}
+	catch ( ... )
+	{
+		// keep the current version, the next save tries again
+		dbLogWarning( "InventoryBucket<%s>::Reload( %s ) failed", stdx::reflection::type_name_v<T>.c_str(), entry->filename.c_str() );
+		std::lock_guard lock( m_mutex );
+		entry->reloading = false;
+		return;
 	}
 
-private:
-	InventoryManager() = default;
-	InventoryManager( const InventoryManager& ) = delete;
+	Evicted evicted;
+	{
+		std::lock_guard lock( m_mutex );
+		dbLog( "InventoryBucket<%s>::Reload( %s )", stdx::reflection::type_name_v<T>.c_str(), entry->filename.c_str() );
 
-	template <typename T>
-	InventoryBucket<T>* GetBucket();
+		// handles may still be reading the old version, it goes once the entry has none left. An item that is always
+		// held would keep every version for the whole session, so only the newest few are kept
+		const size_t size = InventorySizeOf<T>( *item );
+		entry->retired.push_back( std::move( entry->item ) );
+		DropRetired( *entry, Entry::MaxRetired, evicted );
+		entry->item = std::move( item );
+		entry->current.store( entry->item.get(), std::memory_order_release );
+		entry->reloading = false;
 
-private:
-	stdx::flat_map<std::type_index, std::unique_ptr<BaseInventoryBucket>> m_buckets;
-	std::mutex m_mutex;
-};
+		entry->size += size;
+		m_stats.residentBytes += size;
+		m_totalResidentBytes += size;
+		++m_stats.reloads;
+		TrimToBudget( evicted );
+	}
+	evicted.clear();
+
+	InventoryManager::Get()->TrimToBudget();
+
+	events.Execute( [ this, handle = std::move( handle ) ]
+		{
+			m_reloaded( handle );
+		} );
+}
+
+template <typename T>
+void InventoryBucket<T>::WatchLoaded( FileWatcher& watcher )
+{
+	std::lock_guard lock( m_mutex );
+	m_index.ForEach( [ & ]( const Entry& entry )
+		{
+			if ( entry.state == LoadState::Ready && !entry.packed )
+				watcher.Watch( entry.filename );
+		} );
+}
+
+inline void InventoryManager::TrimToBudget()
+{
+	// only cold items can be evicted
+	if ( m_residentBytes <= m_budget || m_coldBytes == 0 )
+		return;
+
+	// buckets are never removed. Evicting without the lock lets destroyed items release their own handles
+	std::vector<BaseInventoryBucket*> buckets;
+	{
+		std::lock_guard lock( m_mutex );
+		buckets.reserve( m_buckets.size() );
+		for ( auto& bucket : m_buckets )
+			buckets.push_back( bucket.get() );
+	}
+
+	while ( m_residentBytes > m_budget )
+	{
+		// oldest cold entry across all buckets goes first
+		BaseInventoryBucket* oldest = nullptr;
+		uint64_t oldestTick = std::numeric_limits<uint64_t>::max();
+		for ( auto* bucket : buckets )
+		{
+			const auto tick = bucket->GetOldestColdTick();
+			if ( tick && *tick < oldestTick )
+			{
+				oldestTick = *tick;
+				oldest = bucket;
+			}
+		}
+
+		// whatever is left is referenced
+		if ( oldest == nullptr || oldest->EvictOldest() == 0 )
+			break;
+	}
+}
+
+inline void InventoryManager::EnableHotReload( Threading::QueuedExecutor events )
+{
+	auto watcher = std::make_unique<FileWatcher>( [ this ]( const std::string& filename ) { OnFileChanged( filename ); } );
+
+	std::lock_guard lock( m_mutex );
+	if ( m_watcher )
+	{
+		dbLogWarning( "InventoryManager hot reload is already enabled" );
+		return;
+	}
+
+	dbLog( "InventoryManager::EnableHotReload()" );
+	m_reloadEvents = std::move( events );
+	m_watcher = std::move( watcher );
+	m_hotReload = true;
+
+	for ( auto& bucket : m_buckets )
+		bucket->WatchLoaded( *m_watcher );
+}
+
+inline void InventoryManager::DisableHotReload()
+{
+	std::unique_ptr<FileWatcher> watcher;
+	{
+		std::lock_guard lock( m_mutex );
+		m_hotReload = false;
+		m_reloadEvents.reset();
+		watcher = std::move( m_watcher );
+	}
+
+	// joins the watcher thread, which may be waiting for the lock in OnFileChanged()
+	watcher.reset();
+}
+
+inline void InventoryManager::WatchFile( const std::string& filename )
+{
+	if ( !m_hotReload )
+		return;
+
+	std::lock_guard lock( m_mutex );
+	if ( m_watcher )
+		m_watcher->Watch( filename );
+}
+
+inline void InventoryManager::OnFileChanged( const std::string& filename )
+{
+	std::vector<BaseInventoryBucket*> buckets;
+	std::optional<Threading::QueuedExecutor> events;
+	{
+		std::lock_guard lock( m_mutex );
+		if ( !m_hotReload )
+			return;
+
+		events = m_reloadEvents;
+		buckets.reserve( m_buckets.size() );
+		for ( auto& bucket : m_buckets )
+			buckets.push_back( bucket.get() );
+	}
+
+	dbLog( "InventoryManager::OnFileChanged( %s )", filename.c_str() );
+	for ( auto* bucket : buckets )
+		bucket->OnFileChanged( filename, *events );
+}
+
+inline bool InventoryManager::MountPack( const std::string& filename )
+{
+	auto pack = std::make_unique<InventoryPack>();
+	if ( !pack->Open( filename ) )
+		return false;
+
+	dbLog( "InventoryManager::MountPack( %s )", filename.c_str() );
+	std::lock_guard lock( m_mutex );
+	m_packs.push_back( std::move( pack ) );
+	return true;
+}
+
+inline std::optional<InventoryBytes> InventoryManager::FindInPacks( std::string_view filename )
+{
+	std::lock_guard lock( m_mutex );
+	for ( auto it = m_packs.rbegin(); it != m_packs.rend(); ++it )
+	{
+		if ( auto bytes = ( *it )->Find( filename ) )
+			return bytes;
+	}
+
+	return std::nullopt;
+}
+
+inline InventoryReadOrder InventoryManager::GetReadOrder( bool fromPacks )
+{
+	std::lock_guard lock( m_mutex );
+	if ( m_readOrder || !fromPacks || m_packs.empty() )
+		return m_readOrder;
+
+	// packs are never unmounted, so the order can hold on to them without the lock
+	std::vector<const InventoryPack*> packs;
+	packs.reserve( m_packs.size() );
+	for ( auto& pack : m_packs )
+		packs.push_back( pack.get() );
+
+	return [ packs = std::move( packs ) ]( std::string_view filename ) -> uint64_t
+	{
+		for ( size_t i = packs.size(); i-- > 0; )
+		{
+			if ( auto bytes = packs[ i ]->Find( filename ) )
+				return ( uint64_t( i ) << 48 ) | packs[ i ]->GetOffset( *bytes );
+		}
+
+		// loose files go last
+		return std::numeric_limits<uint64_t>::max();
+	};
+}
+
+inline InventoryCacheStats InventoryManager::GetStats()
+{
+	std::lock_guard lock( m_mutex );
+
+	InventoryCacheStats stats;
+	for ( auto& bucket : m_buckets )
+		stats += bucket->GetStats();
+
+	return stats;
+}
 
 template <typename T>
 InventoryBucket<T>* InventoryManager::GetBucket()
 {
-	const auto index = std::type_index( typeid( T ) );
+	// the manager is a singleton, so each type resolves its bucket once and later lookups only check the static
+	static InventoryBucket<T>* s_bucket = AddBucket<T>();
+	return s_bucket;
+}
+
+template <typename T>
+InventoryBucket<T>* InventoryManager::AddBucket()
+{
+	dbLog( "creating inventory bucket [%s]", stdx::reflection::type_name_v<T>.c_str() );
+	auto bucket = std::make_unique<InventoryBucket<T>>( m_residentBytes, m_coldBytes, m_budget );
+	auto* result = bucket.get();
 
 	std::lock_guard lock( m_mutex );
+	m_buckets.push_back( std::move( bucket ) );
+	return result;
+}
 
-	auto it = m_buckets.find( index );
-	if ( it == m_buckets.end() )
+inline Threading::Future<void> InventoryManager::LoadManifest( std::string name, const InventoryManifest& manifest, Threading::Priority priority )
+{
+	dbLog( "InventoryManager::LoadManifest( %s )", name.c_str() );
+
+	std::vector<Threading::Future<InventoryManifest::HeldHandles>> batches;
+	batches.reserve( manifest.m_groups.size() );
+	for ( auto& group : manifest.m_groups )
+		batches.push_back( group.prefetch( group.filenames, priority ) );
+
+	auto handles = Threading::WhenAll( std::move( batches ) ).Share();
+
+	Threading::SharedFuture<std::vector<InventoryManifest::HeldHandles>> previous;
+	{
+		std::lock_guard lock( m_manifestMutex );
+		auto it = std::find_if( m_manifests.begin(), m_manifests.end(), [ & ]( const LoadedManifest& loaded ) { return loaded.name == name; } );
+		if ( it != m_manifests.end() )
+			previous = std::exchange( it->handles, handles );
+		else
+			m_manifests.push_back( LoadedManifest{ std::move( name ), handles } );
+	}
+
+	// an unfinished load keeps going and releases its items when done
+	if ( previous.Valid() )
+		previous.Discard();
+
+	return std::move( handles ).Via( Threading::InlineExecutor() ).Then( []( const std::vector<InventoryManifest::HeldHandles>& ) {} );
+}
+
+inline void InventoryManager::UnloadManifest( std::string_view name )
+{
+	dbLog( "InventoryManager::UnloadManifest( %s )", name.data() );
+
+	Threading::SharedFuture<std::vector<InventoryManifest::HeldHandles>> handles;
 	{
-		dbLog( "creating inventory bucket [%s]", stdx::reflection::type_name_v<T>.c_str() );
-		it = m_buckets.insert( { index, std::make_unique<InventoryBucket<T>>() } ).first;
+		std::lock_guard lock( m_manifestMutex );
+		auto it = std::find_if( m_manifests.begin(), m_manifests.end(), [ & ]( const LoadedManifest& loaded ) { return loaded.name == name; } );
+		if ( it == m_manifests.end() )
+			return;
+
+		handles = std::move( it->handles );
+		m_manifests.erase( it );
 	}
 
-	return static_cast<InventoryBucket<T>*>( it->second.get() );
+	handles.Discard();
+}
+
+inline bool InventoryManager::IsManifestLoaded( std::string_view name )
+{
+	std::lock_guard lock( m_manifestMutex );
+	return std::any_of( m_manifests.begin(), m_manifests.end(), [ & ]( const LoadedManifest& loaded ) { return loaded.name == name; } );
+}
+
+template <typename T>
+InventoryManifest& InventoryManifest::Add( std::string filename )
+{
+	auto it = std::find_if( m_groups.begin(), m_groups.end(), []( const Group& group ) { return group.prefetch == &PrefetchGroup<T>; } );
+	if ( it == m_groups.end() )
+		it = m_groups.insert( m_groups.end(), Group{ &PrefetchGroup<T>, {} } );
+
+	it->filenames.push_back( std::move( filename ) );
+	return *this;
+}
+
+template <typename T>
+Threading::Future<InventoryManifest::HeldHandles> InventoryManifest::PrefetchGroup( const std::vector<std::string>& filenames, Threading::Priority priority )
+{
+	return InventoryManager::Get()->Prefetch<T>( filenames, priority ).Via( Threading::InlineExecutor() ).Then( []( std::vector<InventoryHandle<T>> handles )
+		{
+			return HeldHandles( std::make_shared<std::vector<InventoryHandle<T>>>( std::move( handles ) ) );
+		} );
 }
 
 template <typename T>
@@ -322,11 +1284,13 @@ void InventoryHandle<T>::Reset()
 {
 	if ( m_entry )
 	{
-		// no need to be precise about ref count here. UnloadSync makes the final decision to unload
+		// the entry may be evicted once the count drops, so read what we need first.
+		// No need to be precise about ref count here. Release makes the final decision
+		const auto hash = m_entry->hash;
 		dbAssert( m_entry->refCount > 0 );
 		if ( --m_entry->refCount == 0 )
-			InventoryManager::Get()->UnloadSync<T>( m_entry );
+			InventoryManager::Get()->Release<T>( hash );
 
 		m_entry = nullptr;
 	}
-}
\ No newline at end of file
+}
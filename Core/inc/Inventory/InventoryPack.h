@@ -0,0 +1,69 @@
+#pragma once
+
+#include "InventoryIndex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// an item's bytes inside a mapped pack
+struct InventoryBytes
+{
+	const std::byte* data = nullptr;
+	size_t size = 0;
+
+	const std::byte* begin() const noexcept { return data; }
+	const std::byte* end() const noexcept { return data + size; }
+};
+
+// a read only file of items indexed by InventoryItemHash. The whole file is memory mapped on Open(), so finding an
+// item is a binary search over the index and its bytes are used in place without opening or copying anything.
+// Items are 16 byte aligned
+class InventoryPack
+{
+public:
+	InventoryPack() = default;
+
+	~InventoryPack()
+	{
+		Close();
+	}
+
+	InventoryPack( const InventoryPack& ) = delete;
+	InventoryPack& operator=( const InventoryPack& ) = delete;
+
+	// fails if the file is missing or not a valid pack
+	bool Open( const std::string& filename );
+
+	// invalidates the bytes of every item found
+	void Close();
+
+	bool IsOpen() const noexcept
+	{
+		return m_data != nullptr;
+	}
+
+	std::optional<InventoryBytes> Find( std::string_view filename ) const;
+
+	// position of the item in the file, to read items in file order
+	uint64_t GetOffset( const InventoryBytes& bytes ) const noexcept
+	{
+		return static_cast<uint64_t>( bytes.data - m_data );
+	}
+
+	size_t GetCount() const noexcept
+	{
+		return m_count;
+	}
+
+private:
+	const std::byte* m_data = nullptr;
+	size_t m_size = 0;
+	size_t m_count = 0;
+};
+
+// packs every file under directory, in path order. Items are named prefix + their path relative to directory,
+// with forward slashes, which must match the filenames given to InventoryManager
+bool BuildInventoryPack( const std::string& directory, const std::string& filename, std::string_view prefix = {} );
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace Threading
+{
+
+// logical cpu indices
+using CpuSet = std::vector<uint32_t>;
+
+// pins a thread to the given logical cpus. Returns false if pinning failed or is not supported on this platform
+bool SetThreadAffinity( std::thread& thread, const CpuSet& cpus );
+
+// number of NUMA nodes, 1 if unknown
+uint32_t GetNumaNodeCount();
+
+// logical cpus belonging to a NUMA node. Empty if the node does not exist or the platform cannot tell
+CpuSet GetNumaNodeCpus( uint32_t node );
+
+} // namespace Threading
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "Fiber.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#endif
+
+namespace Threading::Detail
+{
+
+using WaitClock = std::chrono::steady_clock;
+
+// a waiter that is woken by callback instead of the condition variable. Used by suspended fibers
+struct ParkedCallback
+{
+	const void* address;
+	void( *wake )( void* context );
+	void* context;
+};
+
+// waiters park on one of a fixed set of condition variables picked by address,
+// so an atomic costs nothing extra until somebody actually blocks on it
+struct ParkingBucket
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<ParkedCallback> parked;
+};
+
+inline ParkingBucket& GetParkingBucket( const void* address ) noexcept
+{
+	static constexpr size_t BucketCount = 64;
+
+	// never destroyed. Pool threads may still notify during static destruction
+	static ParkingBucket* s_buckets = new ParkingBucket[ BucketCount ];
+
+	const auto key = reinterpret_cast<uintptr_t>( address );
+	return s_buckets[ ( key >> 4 ^ key >> 10 ) % BucketCount ];
+}
+
+// blocks while value == old or until the deadline. Returns false on timeout.
+// Timed waits always use the parking buckets since std::atomic::wait cannot time out
+inline bool AtomicWaitUntil( const std::atomic<uint32_t>& value, uint32_t old, WaitClock::time_point deadline ) noexcept
+{
+	auto& bucket = GetParkingBucket( &value );
+	std::unique_lock lock( bucket.mutex );
+	return bucket.condition.wait_until( lock, deadline, [&] { return value.load( std::memory_order_acquire ) != old; } );
+}
+
+// registers wake to be called the next time value is notified. Returns false without registering if value != old
+inline bool AtomicPark( const std::atomic<uint32_t>& value, uint32_t old, void( *wake )( void* ), void* context )
+{
+	auto& bucket = GetParkingBucket( &value );
+	std::lock_guard lock( bucket.mutex );
+	if ( value.load( std::memory_order_acquire ) != old )
+		return false;
+
+	bucket.parked.push_back( ParkedCallback{ &value, wake, context } );
+	return true;
+}
+
+// blocks while value == old, in the parking buckets even where std::atomic::wait is available
+inline void ParkedWait( const std::atomic<uint32_t>& value, uint32_t old ) noexcept
+{
+	auto& bucket = GetParkingBucket( &value );
+	std::unique_lock lock( bucket.mutex );
+	bucket.condition.wait( lock, [&] { return value.load( std::memory_order_acquire ) != old; } );
+}
+
+// wakes every waiter parked on the atomic at address in the bucket. The value was changed before locking,
+// so a waiter is either already parked or will see the new value. Only the address is compared, so the atomic
+// may already be destroyed when its waiters only park in the buckets
+inline void NotifyParkingBucket( const void* address )
+{
+	auto& bucket = GetParkingBucket( address );
+	std::vector<ParkedCallback> woken;
+	{
+		std::lock_guard lock( bucket.mutex );
+		if ( !bucket.parked.empty() )
+		{
+			auto it = std::stable_partition( bucket.parked.begin(), bucket.parked.end(), [ & ]( const ParkedCallback& parked ) { return parked.address != address; } );
+			woken.assign( it, bucket.parked.end() );
+			bucket.parked.erase( it, bucket.parked.end() );
+		}
+	}
+	bucket.condition.notify_all();
+
+	for ( auto& parked : woken )
+		parked.wake( parked.context );
+}
+
+#if defined( __cpp_lib_atomic_wait )
+
+// blocks while value == old
+inline void AtomicWait( const std::atomic<uint32_t>& value, uint32_t old ) noexcept
+{
+	value.wait( old, std::memory_order_acquire );
+}
+
+inline void AtomicNotifyAll( std::atomic<uint32_t>& value ) noexcept
+{
+	value.notify_all();
+
+	// timed waiters and fibers park in the buckets
+	NotifyParkingBucket( &value );
+}
+
+#else
+
+// blocks while value == old
+inline void AtomicWait( const std::atomic<uint32_t>& value, uint32_t old ) noexcept
+{
+	ParkedWait( value, old );
+}
+
+inline void AtomicNotifyAll( std::atomic<uint32_t>& value ) noexcept
+{
+	NotifyParkingBucket( &value );
+}
+
+#endif
+
+inline void CpuRelax() noexcept
+{
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+	_mm_pause();
+#elif defined( __x86_64__ ) || defined( __i386__ )
+	__builtin_ia32_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// lets a blocked thread do useful work instead of sleeping. Pool workers install one that runs a single queued task
+struct WaitHelper
+{
+	bool( *runPendingTask )( void* context ) = nullptr;
+	void* context = nullptr;
+};
+
+inline thread_local WaitHelper t_waitHelper;
+inline thread_local uint32_t t_helpDepth = 0;
+
+// every nested wait adds a frame, so stop helping before the stack gets deep
+inline constexpr uint32_t MaxHelpDepth = 32;
+
+inline bool CanHelp() noexcept
+{
+	return t_waitHelper.runPendingTask != nullptr && t_helpDepth < MaxHelpDepth;
+}
+
+// runs one queued task through the calling thread's wait helper. Returns false if nothing ran
+inline bool RunPendingTask()
+{
+	if ( !CanHelp() )
+		return false;
+
+	const WaitHelper helper = t_waitHelper;
+	++t_helpDepth;
+	const bool ran = helper.runPendingTask( helper.context );
+	--t_helpDepth;
+	return ran;
+}
+
+// spins briefly, then runs queued tasks while ready() is false, then parks on value until ready() or the deadline.
+// Threads with a wait helper park in short slices so they can pick up tasks queued while they sleep.
+// A fiber suspends instead, which frees its worker for other tasks.
+// markWaiting() must return the current value after telling the notifier that somebody may be parked.
+// parkedOnly keeps every wait in the parking buckets, for notifiers that use NotifyParkingBucket()
+template <typename Ready, typename MarkWaiting>
+bool HelpingWait( const std::atomic<uint32_t>& value, Ready&& ready, MarkWaiting&& markWaiting, const WaitClock::time_point* deadline, bool parkedOnly = false )
+{
+	static constexpr int SpinCount = 64;
+	static constexpr auto ParkSlice = std::chrono::milliseconds( 1 );
+
+	for ( int i = 0; i < SpinCount; ++i )
+	{
+		if ( ready() )
+			return true;
+
+		CpuRelax();
+	}
+
+	if ( IsRunningOnFiber() )
+	{
+		// a fiber can resume on another worker, so nothing thread local may be touched in this loop
+		for (;;)
+		{
+			const uint32_t current = markWaiting();
+			if ( ready() )
+				return true;
+
+			if ( deadline )
+			{
+				// timed waits block the worker, the fiber stays on it
+				if ( !AtomicWaitUntil( value, current, *deadline ) )
+					return ready();
+			}
+			else
+			{
+				SuspendFiber( value, current );
+			}
+		}
+	}
+
+	for (;;)
+	{
+		while ( !ready() && RunPendingTask() )
+		{
+			if ( deadline && WaitClock::now() >= *deadline )
+				return ready();
+		}
+
+		const uint32_t current = markWaiting();
+		if ( ready() )
+			return true;
+
+		if ( CanHelp() )
+		{
+			const auto sliceEnd = WaitClock::now() + ParkSlice;
+			AtomicWaitUntil( value, current, deadline ? std::min( *deadline, sliceEnd ) : sliceEnd );
+		}
+		else if ( deadline )
+		{
+			AtomicWaitUntil( value, current, *deadline );
+		}
+		else if ( parkedOnly )
+		{
+			ParkedWait( value, current );
+		}
+		else
+		{
+			AtomicWait( value, current );
+		}
+
+		if ( ready() )
+			return true;
+
+		if ( deadline && WaitClock::now() >= *deadline )
+			return false;
+	}
+}
+
+// lets threads block until some condition guarded elsewhere becomes true. Notify() is a fence and a load
+// unless somebody is waiting, so it is cheap to call after every change to the condition
+class WaitSignal
+{
+public:
+	// blocks until ready(). Pool workers run other tasks meanwhile, fibers suspend
+	template <typename Ready>
+	void Wait( Ready&& ready )
+	{
+		HelpingWait( m_value,
+			ready,
+			[ this ]
+			{
+				const uint32_t current = m_value.fetch_or( Waiting, std::memory_order_seq_cst ) | Waiting;
+
+				// pairs with the fence in Notify(). Either ready() sees the change or the notifier sees the bit
+				std::atomic_thread_fence( std::memory_order_seq_cst );
+				return current;
+			},
+			nullptr );
+	}
+
+	void Notify() noexcept
+	{
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+
+		uint32_t value = m_value.load( std::memory_order_relaxed );
+		while ( value & Waiting )
+		{
+			// bumping the counter changes the value, so a waiter about to park does not
+			if ( m_value.compare_exchange_weak( value, ( value + Step ) & ~Waiting, std::memory_order_acq_rel ) )
+			{
+				AtomicNotifyAll( m_value );
+				return;
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t Waiting = 1;
+	static constexpr uint32_t Step = 2;
+
+	std::atomic<uint32_t> m_value = 0;
+};
+
+} // namespace Threading::Detail
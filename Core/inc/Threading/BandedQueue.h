@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdx/assert.h>
+#include <stdx/bit.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace Threading
+{
+
+// FIFO queue per priority band with a bitmask of non empty bands. Band 0 is the highest priority.
+// Push and pop are O( 1 ). With aging on, an entry is promoted one band for every interval it has waited
+template <typename T, size_t BandCount>
+class BandedQueue
+{
+	static_assert( BandCount > 0 && BandCount <= 32 );
+
+public:
+	bool Empty() const noexcept
+	{
+		return m_nonEmptyBands == 0;
+	}
+
+	size_t Size() const noexcept
+	{
+		return m_size;
+	}
+
+	// 0 turns aging off
+	void SetAgingInterval( std::chrono::nanoseconds interval ) noexcept
+	{
+		m_agingInterval = static_cast<uint64_t>( std::max<std::chrono::nanoseconds::rep>( interval.count(), 0 ) );
+	}
+
+	std::chrono::nanoseconds GetAgingInterval() const noexcept
+	{
+		return std::chrono::nanoseconds( m_agingInterval );
+	}
+
+	void Push( size_t band, T value )
+	{
+		dbAssert( band < BandCount );
+		m_bands[ band ].push_back( Slot{ std::move( value ), m_agingInterval ? Now() : 0 } );
+		m_nonEmptyBands |= 1u << band;
+		++m_size;
+	}
+
+	// oldest entry of the highest ( effective ) priority band
+	T Pop()
+	{
+		dbAssert( !Empty() );
+		return Pop( SelectBand().first );
+	}
+
+	// newest entry of the highest priority band. Used by a worker draining its own queue. An entry aged past the
+	// highest band is still taken oldest first, so a steady stream of pushes cannot starve it
+	T PopNewest()
+	{
+		dbAssert( !Empty() );
+		const size_t selected = SelectBand().first;
+		if ( selected != HighestBand() )
+			return Pop( selected );
+
+		auto& band = m_bands[ selected ];
+		T value = std::move( band.back().value );
+		band.pop_back();
+		OnPopped( band );
+		return value;
+	}
+
+	// effective band of the entry Pop() would return, lower goes first. Aged entries may rank above band 0.
+	// Compares the tops of two queues
+	int64_t GetTopRank() const noexcept
+	{
+		return Empty() ? std::numeric_limits<int64_t>::max() : SelectBand().second;
+	}
+
+	// moves every entry matching pred into removed, keeping the order of the rest. O( n )
+	template <typename Predicate>
+	size_t RemoveIf( Predicate&& pred, std::vector<T>& removed )
+	{
+		const size_t previousCount = removed.size();
+		for ( size_t i = 0; i < BandCount; ++i )
+		{
+			auto& band = m_bands[ i ];
+			auto out = band.begin();
+			for ( auto it = band.begin(); it != band.end(); ++it )
+			{
+				if ( pred( std::as_const( it->value ) ) )
+				{
+					removed.push_back( std::move( it->value ) );
+				}
+				else
+				{
+					if ( out != it )
+						*out = std::move( *it );
+
+					++out;
+				}
+			}
+
+			band.erase( out, band.end() );
+			if ( band.empty() )
+				m_nonEmptyBands &= ~( 1u << i );
+		}
+
+		const size_t removedCount = removed.size() - previousCount;
+		m_size -= removedCount;
+		return removedCount;
+	}
+
+private:
+	struct Slot
+	{
+		T value;
+		uint64_t pushTime;
+	};
+
+	static uint64_t Now() noexcept
+	{
+		return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+	}
+
+	size_t HighestBand() const noexcept
+	{
+		return static_cast<size_t>( stdx::countr_zero( m_nonEmptyBands ) );
+	}
+
+	T Pop( size_t selected )
+	{
+		auto& band = m_bands[ selected ];
+		T value = std::move( band.front().value );
+		band.pop_front();
+		OnPopped( band );
+		return value;
+	}
+
+	// band to pop and its rank, the band less the promotions its front entry has earned
+	std::pair<size_t, int64_t> SelectBand() const noexcept
+	{
+		size_t best = HighestBand();
+		if ( m_agingInterval == 0 )
+			return { best, static_cast<int64_t>( best ) };
+
+		// only the front of each band can be the most promoted, so this is at most BandCount checks
+		const uint64_t now = Now();
+		int64_t bestRank = static_cast<int64_t>( best );
+		for ( uint32_t mask = m_nonEmptyBands & ( m_nonEmptyBands - 1 ); mask != 0; mask &= mask - 1 )
+		{
+			const auto band = static_cast<size_t>( stdx::countr_zero( mask ) );
+			const uint64_t pushTime = m_bands[ band ].front().pushTime;
+			if ( pushTime == 0 )
+				continue;
+
+			const auto promotion = static_cast<int64_t>( ( now - pushTime ) / m_agingInterval );
+			const int64_t rank = static_cast<int64_t>( band ) - promotion;
+			if ( rank < bestRank )
+			{
+				best = band;
+				bestRank = rank;
+			}
+		}
+
+		return { best, bestRank };
+	}
+
+	void OnPopped( const std::deque<Slot>& band ) noexcept
+	{
+		if ( band.empty() )
+			m_nonEmptyBands &= ~( 1u << static_cast<uint32_t>( &band - m_bands.data() ) );
+
+		--m_size;
+	}
+
+private:
+	std::array<std::deque<Slot>, BandCount> m_bands;
+	uint32_t m_nonEmptyBands = 0;
+	size_t m_size = 0;
+	uint64_t m_agingInterval = 0;
+};
+
+} // namespace Threading
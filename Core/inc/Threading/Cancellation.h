@@ -0,0 +1,311 @@
+#pragma once
+
+#include "Execution.h"
+
+#include <stdx/assert.h>
+#include <stdx/type_traits.h>
+#include <stdx/unique_function.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Threading
+{
+
+// error given to the future of a task that was dropped before it ran
+class CancelledError : public std::runtime_error
+{
+public:
+	CancelledError() : std::runtime_error( "operation cancelled" ) {}
+};
+
+class CancellationToken;
+class CancellationSource;
+
+namespace Detail
+{
+
+class CancellationState
+{
+public:
+	using Callback = stdx::unique_function<void()>;
+
+	bool IsCancelled() const noexcept
+	{
+		return m_cancelled.load( std::memory_order_acquire );
+	}
+
+	// returns true for the caller that requested cancellation first
+	bool Cancel()
+	{
+		std::vector<std::pair<uint64_t, Callback>> callbacks;
+		{
+			std::lock_guard lock( m_mutex );
+			if ( m_cancelled.exchange( true, std::memory_order_acq_rel ) )
+				return false;
+
+			callbacks.swap( m_callbacks );
+		}
+
+		for ( auto& entry : callbacks )
+			entry.second();
+
+		return true;
+	}
+
+	// returns 0 and runs f inline if cancellation was already requested
+	uint64_t Register( Callback f )
+	{
+		{
+			std::lock_guard lock( m_mutex );
+			if ( !IsCancelled() )
+			{
+				const uint64_t id = ++m_nextId;
+				m_callbacks.emplace_back( id, std::move( f ) );
+				return id;
+			}
+		}
+
+		f();
+		return 0;
+	}
+
+	void Unregister( uint64_t id )
+	{
+		// destroyed outside the lock
+		Callback removed;
+		{
+			std::lock_guard lock( m_mutex );
+			auto it = std::find_if( m_callbacks.begin(), m_callbacks.end(), [ id ]( auto& entry ) { return entry.first == id; } );
+			if ( it == m_callbacks.end() )
+				return;
+
+			removed = std::move( it->second );
+			*it = std::move( m_callbacks.back() );
+			m_callbacks.pop_back();
+		}
+	}
+
+private:
+	std::atomic<bool> m_cancelled = false;
+	std::mutex m_mutex;
+	std::vector<std::pair<uint64_t, Callback>> m_callbacks;
+	uint64_t m_nextId = 0;
+};
+
+} // namespace Detail
+
+// unregisters its callback when destroyed. A callback that has already started is not waited for
+class [[nodiscard]] CancellationRegistration
+{
+public:
+	CancellationRegistration() noexcept = default;
+
+	CancellationRegistration( CancellationRegistration&& other ) noexcept
+		: m_state( std::move( other.m_state ) )
+		, m_id( std::exchange( other.m_id, 0 ) )
+	{}
+
+	CancellationRegistration& operator=( CancellationRegistration&& other ) noexcept
+	{
+		Reset();
+		m_state = std::move( other.m_state );
+		m_id = std::exchange( other.m_id, 0 );
+		return *this;
+	}
+
+	CancellationRegistration( const CancellationRegistration& ) = delete;
+	CancellationRegistration& operator=( const CancellationRegistration& ) = delete;
+
+	~CancellationRegistration()
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		if ( m_state && m_id != 0 )
+			m_state->Unregister( m_id );
+
+		m_state = nullptr;
+		m_id = 0;
+	}
+
+private:
+	CancellationRegistration( std::shared_ptr<Detail::CancellationState> state, uint64_t id ) noexcept
+		: m_state( std::move( state ) )
+		, m_id( id )
+	{}
+
+	std::shared_ptr<Detail::CancellationState> m_state;
+	uint64_t m_id = 0;
+
+	friend class CancellationToken;
+};
+
+// cheap to copy. A default constructed token can never be cancelled
+class CancellationToken
+{
+public:
+	CancellationToken() noexcept = default;
+
+	bool CanBeCancelled() const noexcept
+	{
+		return m_state != nullptr;
+	}
+
+	bool IsCancellationRequested() const noexcept
+	{
+		return m_state && m_state->IsCancelled();
+	}
+
+	void ThrowIfCancellationRequested() const
+	{
+		if ( IsCancellationRequested() )
+			throw CancelledError();
+	}
+
+	// f runs on the thread that requests cancellation, or inline if it was already requested
+	template <typename Function>
+	CancellationRegistration Register( Function&& f ) const
+	{
+		if ( !m_state )
+			return {};
+
+		const uint64_t id = m_state->Register( std::forward<Function>( f ) );
+		return id ? CancellationRegistration( m_state, id ) : CancellationRegistration();
+	}
+
+	bool operator==( const CancellationToken& other ) const noexcept { return m_state == other.m_state; }
+	bool operator!=( const CancellationToken& other ) const noexcept { return m_state != other.m_state; }
+
+private:
+	explicit CancellationToken( std::shared_ptr<Detail::CancellationState> state ) noexcept : m_state( std::move( state ) ) {}
+
+	std::shared_ptr<Detail::CancellationState> m_state;
+
+	friend class CancellationSource;
+};
+
+class CancellationSource
+{
+public:
+	CancellationSource() : m_state( std::make_shared<Detail::CancellationState>() ) {}
+
+	CancellationToken GetToken() const noexcept
+	{
+		return CancellationToken( m_state );
+	}
+
+	// runs registered callbacks on this thread. Returns false if cancellation was already requested
+	bool Cancel()
+	{
+		return m_state->Cancel();
+	}
+
+	bool IsCancellationRequested() const noexcept
+	{
+		return m_state->IsCancelled();
+	}
+
+private:
+	std::shared_ptr<Detail::CancellationState> m_state;
+};
+
+namespace Detail
+{
+	// set while an executor destroys a task it dropped. Tasks destroyed for any other reason, like the executor
+	// being torn down, leave their future alone
+	inline thread_local bool t_droppingTask = false;
+
+	// claimed by the first task destroyed under DropTask(), so tasks destroyed by its continuations are not dropped too
+	inline bool ClaimDroppedTask() noexcept
+	{
+		return std::exchange( t_droppingTask, false );
+	}
+
+	// destroys a task that will never run. A continuation task fails its future with CancelledError
+	template <typename Function>
+	void DropTask( Function&& f )
+	{
+		t_droppingTask = true;
+		{
+			std::decay_t<Function> dropped( std::forward<Function>( f ) );
+		}
+		t_droppingTask = false;
+	}
+
+	template <typename Exec, typename Function>
+	using ExecuteCancellableType = decltype( std::declval<const Exec>().ExecuteCancellable( std::declval<Function>(), std::declval<const CancellationToken&>() ) );
+}
+
+// skips tasks that have not started once the token is cancelled. A skipped task is dropped, which fails the
+// future of a continuation with CancelledError. Executors with ExecuteCancellable() get the
+// token so they can drop the task from their queue
+template <typename Exec>
+class CancellableExecutor
+{
+public:
+	CancellableExecutor( const Exec& exec, CancellationToken token )
+		: m_executor( exec )
+		, m_token( std::move( token ) )
+	{}
+
+	template <typename Function>
+	void Execute( Function&& f ) const
+	{
+		if ( m_token.IsCancellationRequested() )
+		{
+			Detail::DropTask( std::forward<Function>( f ) );
+			return;
+		}
+
+		if constexpr ( stdx::is_detected_v<Detail::ExecuteCancellableType, Exec, Function&&> )
+		{
+			m_executor.ExecuteCancellable( std::forward<Function>( f ), m_token );
+		}
+		else
+		{
+			Threading::Execute( m_executor, [ token = m_token, f = std::forward<Function>( f ) ]() mutable
+				{
+					if ( !token.IsCancellationRequested() )
+						std::move( f )();
+					else
+						Detail::DropTask( std::move( f ) );
+				} );
+		}
+	}
+
+	size_t GetConcurrency() const noexcept
+	{
+		return Threading::GetConcurrency( m_executor );
+	}
+
+	const Exec& GetInnerExecutor() const noexcept
+	{
+		return m_executor;
+	}
+
+	const CancellationToken& GetToken() const noexcept
+	{
+		return m_token;
+	}
+
+	bool operator==( const CancellableExecutor& other ) const noexcept { return m_executor == other.m_executor && m_token == other.m_token; }
+	bool operator!=( const CancellableExecutor& other ) const noexcept { return !( *this == other ); }
+
+private:
+	Exec m_executor;
+	CancellationToken m_token;
+};
+
+template <typename Exec>
+CancellableExecutor( const Exec&, CancellationToken )->CancellableExecutor<Exec>;
+
+} // namespace Threading
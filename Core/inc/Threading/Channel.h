@@ -0,0 +1,492 @@
+#pragma once
+
+#include "AtomicWait.h"
+#include "Future.h"
+#include "MpscQueue.h"
+
+#include <stdx/assert.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Threading
+{
+
+// error given to receivers once a closed channel is empty
+class ChannelClosedError : public std::runtime_error
+{
+public:
+	ChannelClosedError() : std::runtime_error( "channel closed" ) {}
+};
+
+enum class ChannelMode
+{
+	// any number of senders and receivers
+	MPMC,
+
+	// one sending thread and one receiving thread at a time. A pending ReceiveAsync() future is served from
+	// the sending thread, so the receiver must not poll while one is pending
+	SPSC
+};
+
+namespace Detail
+{
+
+// bounded lock free multi producer multi consumer ring ( Vyukov ). Each cell carries a sequence number
+// that tells producers and consumers whose turn it is
+template <typename T>
+class BoundedMpmcQueue
+{
+public:
+	explicit BoundedMpmcQueue( size_t capacity )
+	{
+		size_t size = 2;
+		while ( size < capacity )
+			size *= 2;
+
+		m_cells = std::make_unique<Cell[]>( size );
+		m_mask = size - 1;
+		for ( size_t i = 0; i < size; ++i )
+			m_cells[ i ].sequence.store( i, std::memory_order_relaxed );
+	}
+
+	// leaves value alone if full
+	bool TryPush( T& value )
+	{
+		Cell* cell;
+		size_t position = m_enqueue.load( std::memory_order_relaxed );
+		for (;;)
+		{
+			cell = &m_cells[ position & m_mask ];
+			const size_t sequence = cell->sequence.load( std::memory_order_acquire );
+			const auto diff = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( position );
+			if ( diff == 0 )
+			{
+				if ( m_enqueue.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if ( diff < 0 )
+			{
+				return false;
+			}
+			else
+			{
+				position = m_enqueue.load( std::memory_order_relaxed );
+			}
+		}
+
+		cell->value = std::move( value );
+		cell->sequence.store( position + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool TryPop( T& value )
+	{
+		Cell* cell;
+		size_t position = m_dequeue.load( std::memory_order_relaxed );
+		for (;;)
+		{
+			cell = &m_cells[ position & m_mask ];
+			const size_t sequence = cell->sequence.load( std::memory_order_acquire );
+			const auto diff = static_cast<intptr_t>( sequence ) - static_cast<intptr_t>( position + 1 );
+			if ( diff == 0 )
+			{
+				if ( m_dequeue.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if ( diff < 0 )
+			{
+				return false;
+			}
+			else
+			{
+				position = m_dequeue.load( std::memory_order_relaxed );
+			}
+		}
+
+		value = std::move( cell->value );
+		cell->sequence.store( position + m_mask + 1, std::memory_order_release );
+		return true;
+	}
+
+	// approximate while pushes and pops are in flight
+	size_t GetSize() const noexcept
+	{
+		const size_t dequeue = m_dequeue.load( std::memory_order_acquire );
+		const size_t enqueue = m_enqueue.load( std::memory_order_acquire );
+		return enqueue > dequeue ? enqueue - dequeue : 0;
+	}
+
+	size_t GetCapacity() const noexcept
+	{
+		return m_mask + 1;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> m_cells;
+	size_t m_mask = 0;
+
+	alignas( 64 ) std::atomic<size_t> m_enqueue = 0;
+	alignas( 64 ) std::atomic<size_t> m_dequeue = 0;
+};
+
+// bounded wait free single producer single consumer ring
+template <typename T>
+class SpscRingQueue
+{
+public:
+	explicit SpscRingQueue( size_t capacity )
+	{
+		size_t size = 2;
+		while ( size < capacity )
+			size *= 2;
+
+		m_cells = std::make_unique<T[]>( size );
+		m_mask = size - 1;
+	}
+
+	// producer only. Leaves value alone if full
+	bool TryPush( T& value )
+	{
+		const size_t tail = m_tail.load( std::memory_order_relaxed );
+		if ( tail - m_head.load( std::memory_order_acquire ) > m_mask )
+			return false;
+
+		m_cells[ tail & m_mask ] = std::move( value );
+		m_tail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+
+	// consumer only
+	bool TryPop( T& value )
+	{
+		const size_t head = m_head.load( std::memory_order_relaxed );
+		if ( head == m_tail.load( std::memory_order_acquire ) )
+			return false;
+
+		value = std::move( m_cells[ head & m_mask ] );
+		m_head.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	size_t GetSize() const noexcept
+	{
+		const size_t head = m_head.load( std::memory_order_acquire );
+		const size_t tail = m_tail.load( std::memory_order_acquire );
+		return tail - head;
+	}
+
+	size_t GetCapacity() const noexcept
+	{
+		return m_mask + 1;
+	}
+
+private:
+	std::unique_ptr<T[]> m_cells;
+	size_t m_mask = 0;
+
+	alignas( 64 ) std::atomic<size_t> m_head = 0;
+	alignas( 64 ) std::atomic<size_t> m_tail = 0;
+};
+
+// storage picked by mode and capacity. The unbounded MPMC queue lets receivers take turns on the consumer side of
+// an MpscQueue with a spin lock held for a single pop, so senders never wait
+template <typename T, ChannelMode Mode>
+class ChannelQueue
+{
+	using Bounded = std::conditional_t<Mode == ChannelMode::SPSC, SpscRingQueue<T>, BoundedMpmcQueue<T>>;
+
+public:
+	explicit ChannelQueue( size_t capacity )
+	{
+		if ( capacity > 0 )
+			m_bounded.emplace( capacity );
+		else
+			m_unbounded = std::make_unique<MpscQueue<T>>();
+	}
+
+	bool TryPush( T& value )
+	{
+		if ( m_bounded )
+			return m_bounded->TryPush( value );
+
+		m_unbounded->Push( std::move( value ) );
+		m_size.fetch_add( 1, std::memory_order_release );
+		return true;
+	}
+
+	bool TryPop( T& value )
+	{
+		if ( m_bounded )
+			return m_bounded->TryPop( value );
+
+		if constexpr ( Mode == ChannelMode::MPMC )
+		{
+			while ( m_consumerLock.exchange( true, std::memory_order_acquire ) )
+				CpuRelax();
+		}
+
+		const bool popped = m_unbounded->TryPop( value );
+
+		if constexpr ( Mode == ChannelMode::MPMC )
+			m_consumerLock.store( false, std::memory_order_release );
+
+		if ( popped )
+			m_size.fetch_sub( 1, std::memory_order_release );
+
+		return popped;
+	}
+
+	bool IsBounded() const noexcept
+	{
+		return m_bounded.has_value();
+	}
+
+	// approximate while sends and receives are in flight
+	size_t GetSize() const noexcept
+	{
+		return m_bounded ? m_bounded->GetSize() : m_size.load( std::memory_order_acquire );
+	}
+
+	// zero if unbounded
+	size_t GetCapacity() const noexcept
+	{
+		return m_bounded ? m_bounded->GetCapacity() : 0;
+	}
+
+private:
+	std::optional<Bounded> m_bounded;
+	std::unique_ptr<MpscQueue<T>> m_unbounded;
+	std::atomic<size_t> m_size = 0;
+	std::atomic<bool> m_consumerLock = false;
+};
+
+} // namespace Detail
+
+// hands values from senders to receivers without a shared lock. A capacity of zero makes it unbounded, otherwise the
+// capacity is rounded up to a power of two and Send() blocks while it is full. Receivers either poll, block or take
+// a future, which coroutines can co_await. Close() stops sends. Receivers drain what is left and then get
+// ChannelClosedError or nullopt. A send racing with Close() may still land after it.
+// T must be default constructible and movable
+template <typename T, ChannelMode Mode = ChannelMode::MPMC>
+class Channel
+{
+public:
+	explicit Channel( size_t capacity = 0 ) : m_queue( capacity ) {}
+
+	Channel( const Channel& ) = delete;
+	Channel& operator=( const Channel& ) = delete;
+
+	~Channel()
+	{
+		dbAssertMessage( m_waiterCount == 0, "channel destroyed with pending ReceiveAsync() futures" );
+	}
+
+	// returns false and leaves value alone if the channel is full or closed
+	bool TrySend( T& value )
+	{
+		if ( IsClosed() || !m_queue.TryPush( value ) )
+			return false;
+
+		OnSent();
+		return true;
+	}
+
+	bool TrySend( T&& value )
+	{
+		return TrySend( value );
+	}
+
+	// blocks while the channel is full. Returns false if it was closed first
+	bool Send( T value )
+	{
+		for (;;)
+		{
+			if ( IsClosed() )
+				return false;
+
+			if ( m_queue.TryPush( value ) )
+			{
+				OnSent();
+				return true;
+			}
+
+			m_spaceSignal.Wait( [ this ] { return IsClosed() || m_queue.GetSize() < m_queue.GetCapacity(); } );
+		}
+	}
+
+	// returns false if the channel is empty
+	bool TryReceive( T& value )
+	{
+		if ( !m_queue.TryPop( value ) )
+			return false;
+
+		OnReceived();
+		return true;
+	}
+
+	// appends up to maxCount values. Returns the number received
+	size_t TryReceive( std::vector<T>& values, size_t maxCount )
+	{
+		size_t count = 0;
+		T value;
+		while ( count < maxCount && m_queue.TryPop( value ) )
+		{
+			values.push_back( std::move( value ) );
+			++count;
+		}
+
+		if ( count > 0 )
+			OnReceived();
+
+		return count;
+	}
+
+	// blocks until a value arrives. Returns nullopt once the channel is closed and empty
+	std::optional<T> Receive()
+	{
+		T value;
+		for (;;)
+		{
+			if ( TryReceive( value ) )
+				return std::optional<T>( std::move( value ) );
+
+			if ( IsClosed() )
+			{
+				// a send may have landed between the failed pop and the close
+				if ( TryReceive( value ) )
+					return std::optional<T>( std::move( value ) );
+
+				return std::nullopt;
+			}
+
+			m_itemSignal.Wait( [ this ] { return IsClosed() || m_queue.GetSize() > 0; } );
+		}
+	}
+
+	// ready now if a value is waiting. Otherwise the future is completed by a later send, in request order,
+	// or fails with ChannelClosedError once the channel is closed and empty
+	Future<T> ReceiveAsync()
+	{
+		T value;
+		if ( TryReceive( value ) )
+			return MakeReadyFuture<T>( std::move( value ) );
+
+		auto[ future, promise ] = MakeFuturePromisePair<T>();
+		{
+			std::lock_guard lock( m_waiterMutex );
+			m_waiters.push_back( std::move( promise ) );
+			m_waiterCount.fetch_add( 1, std::memory_order_seq_cst );
+		}
+
+		// a value sent before the waiter was counted would not have been handed to it
+		ServeWaiters();
+		return std::move( future );
+	}
+
+	// wakes blocked senders and receivers. Returns false if already closed
+	bool Close()
+	{
+		if ( m_closed.exchange( true, std::memory_order_acq_rel ) )
+			return false;
+
+		ServeWaiters();
+		m_itemSignal.Notify();
+		m_spaceSignal.Notify();
+		return true;
+	}
+
+	bool IsClosed() const noexcept
+	{
+		return m_closed.load( std::memory_order_acquire );
+	}
+
+	// approximate while sends and receives are in flight
+	size_t GetSize() const noexcept
+	{
+		return m_queue.GetSize();
+	}
+
+	// zero if unbounded
+	size_t GetCapacity() const noexcept
+	{
+		return m_queue.GetCapacity();
+	}
+
+private:
+	void OnSent()
+	{
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if ( m_waiterCount.load( std::memory_order_relaxed ) > 0 )
+			ServeWaiters();
+
+		m_itemSignal.Notify();
+	}
+
+	void OnReceived()
+	{
+		if ( m_queue.IsBounded() )
+			m_spaceSignal.Notify();
+	}
+
+	// hands queued values to pending futures. Promises are completed outside the lock since continuations run inline
+	void ServeWaiters()
+	{
+		std::vector<std::pair<Promise<T>, T>> served;
+		std::vector<Promise<T>> closed;
+		{
+			std::lock_guard lock( m_waiterMutex );
+
+			T value;
+			while ( !m_waiters.empty() && m_queue.TryPop( value ) )
+			{
+				served.emplace_back( std::move( m_waiters.front() ), std::move( value ) );
+				m_waiters.pop_front();
+			}
+
+			if ( IsClosed() && m_queue.GetSize() == 0 )
+			{
+				closed.assign( std::make_move_iterator( m_waiters.begin() ), std::make_move_iterator( m_waiters.end() ) );
+				m_waiters.clear();
+			}
+
+			m_waiterCount.store( m_waiters.size(), std::memory_order_relaxed );
+		}
+
+		for ( auto& [ promise, value ] : served )
+			promise.SetValue( std::move( value ) );
+
+		for ( auto& promise : closed )
+			promise.SetError( std::make_exception_ptr( ChannelClosedError() ) );
+
+		if ( !served.empty() )
+			OnReceived();
+	}
+
+private:
+	Detail::ChannelQueue<T, Mode> m_queue;
+	std::atomic<bool> m_closed = false;
+
+	Detail::WaitSignal m_itemSignal;
+	Detail::WaitSignal m_spaceSignal;
+
+	// ReceiveAsync() futures waiting for a value. Only touched when the channel runs dry
+	std::mutex m_waiterMutex;
+	std::deque<Promise<T>> m_waiters;
+	std::atomic<size_t> m_waiterCount = 0;
+};
+
+} // namespace Threading
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Cancellation.h"
 #include "Execution.h"
 #include "Promise.h"
 
@@ -260,9 +261,19 @@ namespace Detail
 			, m_function( std::move( f ) )
 		{}
 
+		Task( Task&& ) = default;
+		Task& operator=( Task&& ) = default;
+
+		// a task dropped by its executor fails its future instead of leaving it pending forever
+		~Task()
+		{
+			if ( m_promise.Valid() && ClaimDroppedTask() )
+				m_promise.SetError( std::make_exception_ptr( CancelledError() ) );
+		}
+
 		void operator()() noexcept
 		{
-			InvokeContinuation( m_promise, m_function );
+			InvokeContinuation( std::move( m_promise ), std::move( m_function ) );
 		}
 
 	private:
@@ -286,11 +297,20 @@ namespace Detail
 			, m_function( std::move( f ) )
 		{}
 
+		ErrorTask( ErrorTask&& ) = default;
+		ErrorTask& operator=( ErrorTask&& ) = default;
+
+		~ErrorTask()
+		{
+			if ( m_promise.Valid() && ClaimDroppedTask() )
+				m_promise.SetError( std::make_exception_ptr( CancelledError() ) );
+		}
+
 		void operator()() noexcept
 		{
 			try
 			{
-				std::invoke( m_function, m_error );
+				std::invoke( std::move( m_function ), m_error );
 			}
 			catch ( ... )
 			{
@@ -0,0 +1,612 @@
+#pragma once
+
+#if defined( __cpp_impl_coroutine ) && __has_include( <coroutine> )
+
+#include "Future.h"
+
+#include <stdx/assert.h>
+#include <stdx/unique_function.h>
+
+#include <array>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+
+namespace Threading
+{
+
+template <typename T = void>
+class CoTask;
+
+namespace Detail
+{
+
+// thread local size class cache for coroutine frames. Frames freed on another thread join that thread's cache
+class CoFramePool
+{
+public:
+	static void* Allocate( size_t size )
+	{
+		const size_t sizeClass = GetSizeClass( size );
+		if ( sizeClass < ClassCount && !t_cacheDestroyed )
+		{
+			auto& cache = GetCache();
+			if ( FreeNode* node = cache.heads[ sizeClass ] )
+			{
+				cache.heads[ sizeClass ] = node->next;
+				--cache.counts[ sizeClass ];
+				return node;
+			}
+
+			return ::operator new( ( sizeClass + 1 ) * Granularity );
+		}
+
+		return ::operator new( size );
+	}
+
+	static void Deallocate( void* block, size_t size ) noexcept
+	{
+		const size_t sizeClass = GetSizeClass( size );
+		if ( sizeClass < ClassCount && !t_cacheDestroyed )
+		{
+			auto& cache = GetCache();
+			if ( cache.counts[ sizeClass ] < MaxCachedPerClass )
+			{
+				cache.heads[ sizeClass ] = new( block ) FreeNode{ cache.heads[ sizeClass ] };
+				++cache.counts[ sizeClass ];
+				return;
+			}
+		}
+
+		::operator delete( block );
+	}
+
+private:
+	static constexpr size_t Granularity = 64;
+	static constexpr size_t ClassCount = 16;
+	static constexpr uint32_t MaxCachedPerClass = 32;
+
+	struct FreeNode
+	{
+		FreeNode* next;
+	};
+
+	struct Cache
+	{
+		~Cache()
+		{
+			t_cacheDestroyed = true;
+			for ( FreeNode* node : heads )
+			{
+				while ( node )
+					::operator delete( std::exchange( node, node->next ) );
+			}
+		}
+
+		std::array<FreeNode*, ClassCount> heads{};
+		std::array<uint32_t, ClassCount> counts{};
+	};
+
+	static constexpr size_t GetSizeClass( size_t size ) noexcept
+	{
+		return ( size - 1 ) / Granularity;
+	}
+
+	static Cache& GetCache() noexcept
+	{
+		thread_local Cache t_cache;
+		return t_cache;
+	}
+
+	// frames can still be freed by other thread locals after the cache is gone
+	static inline thread_local bool t_cacheDestroyed = false;
+};
+
+// type erased executor that resumes coroutine handles
+class CoScheduler
+{
+public:
+	template <typename Exec>
+	explicit CoScheduler( const Exec& exec )
+	{
+		if constexpr ( !std::is_same_v<Exec, InlineExecutor> )
+		{
+			m_schedule = [ exec ]( std::coroutine_handle<> handle )
+			{
+				Threading::Execute( exec, [ handle ] { handle.resume(); } );
+			};
+		}
+	}
+
+	void Schedule( std::coroutine_handle<> handle )
+	{
+		if ( m_schedule )
+			m_schedule( handle );
+		else
+			handle.resume();
+	}
+
+private:
+	stdx::unique_function<void( std::coroutine_handle<> )> m_schedule;
+};
+
+template <typename Promise>
+using GetSchedulerType = decltype( std::declval<Promise&>().GetScheduler() );
+
+// scheduler of the coroutine that is suspending, or null if it resumes wherever it is woken up
+template <typename Promise>
+CoScheduler* GetCoScheduler( std::coroutine_handle<Promise> handle ) noexcept
+{
+	if constexpr ( stdx::is_detected_v<GetSchedulerType, Promise> )
+		return handle.promise().GetScheduler();
+	else
+		return nullptr;
+}
+
+inline void Resume( CoScheduler* scheduler, std::coroutine_handle<> handle )
+{
+	if ( scheduler )
+		scheduler->Schedule( handle );
+	else
+		handle.resume();
+}
+
+// awaits a future's shared state. Non void Exec resumes through that executor instead of the coroutine's scheduler
+template <typename T, bool Shared, typename Exec = void>
+class FutureAwaiter
+{
+public:
+	explicit FutureAwaiter( SharedStatePtr<T> state ) noexcept : m_state( std::move( state ) )
+	{
+		dbAssert( m_state );
+	}
+
+	template <typename E>
+	FutureAwaiter( SharedStatePtr<T> state, const E& exec ) : m_state( std::move( state ) ), m_executor( exec )
+	{
+		dbAssert( m_state );
+	}
+
+	bool await_ready() const noexcept
+	{
+		return m_state->IsReady();
+	}
+
+	template <typename Promise>
+	void await_suspend( std::coroutine_handle<Promise> handle )
+	{
+		// the coroutine may be resumed and destroy this awaiter before SetContinuation returns
+		auto state = m_state;
+
+		if constexpr ( std::is_void_v<Exec> )
+		{
+			state->SetContinuation( [ handle, scheduler = GetCoScheduler( handle ) ]( auto& )
+				{
+					Resume( scheduler, handle );
+				} );
+		}
+		else
+		{
+			state->SetContinuation( [ handle, exec = m_executor ]( auto& )
+				{
+					Threading::Execute( exec, [ handle ] { handle.resume(); } );
+				} );
+		}
+	}
+
+	T await_resume()
+	{
+		if constexpr ( Shared )
+			return std::as_const( *m_state ).Get();
+		else
+			return std::move( *m_state ).Get();
+	}
+
+private:
+	struct NoExecutor {};
+
+	SharedStatePtr<T> m_state;
+	[[no_unique_address]] std::conditional_t<std::is_void_v<Exec>, NoExecutor, Exec> m_executor;
+};
+
+class CoPromiseBase
+{
+public:
+	using FrameDeleter = void( * )( void* frame, size_t size ) noexcept;
+
+	// frames come from the pool. The deleter is stored after the frame so one operator delete handles every allocation path
+	static void* operator new( size_t size )
+	{
+		void* frame = CoFramePool::Allocate( size + sizeof( FrameDeleter ) );
+		StoreDeleter( frame, size, &DeletePooledFrame );
+		return frame;
+	}
+
+	// CoTask<T> Foo( std::allocator_arg_t, const Alloc&, ... ) allocates its frame from the given allocator
+	template <typename Alloc, typename... Args>
+	static void* operator new( size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&... )
+	{
+		return AllocateFrame( size, alloc );
+	}
+
+	template <typename This, typename Alloc, typename... Args>
+	static void* operator new( size_t size, const This&, std::allocator_arg_t, const Alloc& alloc, const Args&... )
+	{
+		return AllocateFrame( size, alloc );
+	}
+
+	static void operator delete( void* frame, size_t size ) noexcept
+	{
+		FrameDeleter deleter;
+		std::memcpy( &deleter, static_cast<std::byte*>( frame ) + size, sizeof( deleter ) );
+		deleter( frame, size );
+	}
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+
+		// symmetric transfer back to the awaiting coroutine keeps the stack flat
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) noexcept
+		{
+			auto continuation = handle.promise().m_continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	FinalAwaiter final_suspend() noexcept { return {}; }
+
+	CoScheduler* GetScheduler() const noexcept
+	{
+		return m_scheduler;
+	}
+
+	void SetContinuation( std::coroutine_handle<> continuation, CoScheduler* scheduler ) noexcept
+	{
+		m_continuation = continuation;
+		m_scheduler = scheduler;
+	}
+
+	// futures awaited from now on resume on exec. Tasks this coroutine awaits inherit it
+	template <typename Exec>
+	void SetScheduler( const Exec& exec )
+	{
+		m_ownScheduler.emplace( exec );
+		m_scheduler = &*m_ownScheduler;
+	}
+
+private:
+	template <typename Alloc>
+	using ByteAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<std::max_align_t>;
+
+	static void StoreDeleter( void* frame, size_t size, FrameDeleter deleter ) noexcept
+	{
+		std::memcpy( static_cast<std::byte*>( frame ) + size, &deleter, sizeof( deleter ) );
+	}
+
+	static void DeletePooledFrame( void* frame, size_t size ) noexcept
+	{
+		CoFramePool::Deallocate( frame, size + sizeof( FrameDeleter ) );
+	}
+
+	template <typename Alloc>
+	static size_t GetAllocatorOffset( size_t size ) noexcept
+	{
+		static_assert( alignof( Alloc ) <= alignof( std::max_align_t ) );
+		const size_t offset = size + sizeof( FrameDeleter );
+		return ( offset + alignof( Alloc ) - 1 ) & ~( alignof( Alloc ) - 1 );
+	}
+
+	template <typename Alloc>
+	static size_t GetAllocationCount( size_t size ) noexcept
+	{
+		return ( GetAllocatorOffset<Alloc>( size ) + sizeof( Alloc ) + sizeof( std::max_align_t ) - 1 ) / sizeof( std::max_align_t );
+	}
+
+	template <typename Alloc>
+	static void* AllocateFrame( size_t size, const Alloc& alloc )
+	{
+		ByteAllocator<Alloc> byteAlloc( alloc );
+		void* frame = std::allocator_traits<ByteAllocator<Alloc>>::allocate( byteAlloc, GetAllocationCount<Alloc>( size ) );
+		new( static_cast<std::byte*>( frame ) + GetAllocatorOffset<Alloc>( size ) ) ByteAllocator<Alloc>( std::move( byteAlloc ) );
+		StoreDeleter( frame, size, &DeleteAllocatedFrame<ByteAllocator<Alloc>> );
+		return frame;
+	}
+
+	template <typename Alloc>
+	static void DeleteAllocatedFrame( void* frame, size_t size ) noexcept
+	{
+		auto* stored = std::launder( reinterpret_cast<Alloc*>( static_cast<std::byte*>( frame ) + GetAllocatorOffset<Alloc>( size ) ) );
+		Alloc alloc( std::move( *stored ) );
+		std::destroy_at( stored );
+		std::allocator_traits<Alloc>::deallocate( alloc, static_cast<std::max_align_t*>( frame ), GetAllocationCount<Alloc>( size ) );
+	}
+
+private:
+	std::coroutine_handle<> m_continuation;
+	CoScheduler* m_scheduler = nullptr;
+	std::optional<CoScheduler> m_ownScheduler;
+};
+
+template <typename T>
+class CoTaskPromise : public CoPromiseBase
+{
+public:
+	template <typename U = T>
+	void return_value( U&& value )
+	{
+		m_result.emplace( std::in_place, std::forward<U>( value ) );
+	}
+
+	void unhandled_exception() noexcept
+	{
+		m_result.emplace( stdx::unexpect, std::current_exception() );
+	}
+
+	Expected<T>& GetResult() noexcept
+	{
+		dbAssert( m_result );
+		return *m_result;
+	}
+
+private:
+	std::optional<Expected<T>> m_result;
+};
+
+template <>
+class CoTaskPromise<void> : public CoPromiseBase
+{
+public:
+	void return_void() noexcept {}
+
+	void unhandled_exception() noexcept
+	{
+		m_error = std::current_exception();
+	}
+
+	Expected<void> GetResult() noexcept
+	{
+		if ( m_error )
+			return Expected<void>( stdx::unexpect, std::move( m_error ) );
+
+		return Expected<void>();
+	}
+
+private:
+	std::exception_ptr m_error;
+};
+
+// fire and forget coroutine that owns the scheduler of a started CoTask
+class CoRoot
+{
+public:
+	struct promise_type
+	{
+		template <typename Exec, typename... Args>
+		explicit promise_type( const Exec& exec, Args&... ) : m_scheduler( exec ) {}
+
+		CoRoot get_return_object() noexcept { return {}; }
+
+		auto initial_suspend() noexcept
+		{
+			struct ScheduleAwaiter
+			{
+				bool await_ready() const noexcept { return false; }
+				void await_suspend( std::coroutine_handle<promise_type> handle ) { handle.promise().m_scheduler.Schedule( handle ); }
+				void await_resume() const noexcept {}
+			};
+
+			return ScheduleAwaiter{};
+		}
+
+		std::suspend_never final_suspend() noexcept { return {}; }
+
+		void return_void() noexcept {}
+
+		// the body hands every error to its promise, so nothing can escape
+		void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+
+		CoScheduler* GetScheduler() noexcept
+		{
+			return &m_scheduler;
+		}
+
+		static void* operator new( size_t size ) { return CoFramePool::Allocate( size ); }
+		static void operator delete( void* frame, size_t size ) noexcept { CoFramePool::Deallocate( frame, size ); }
+
+	private:
+		CoScheduler m_scheduler;
+	};
+};
+
+template <typename T, typename Exec>
+CoRoot StartCoTask( const Exec&, CoTask<T> task, Promise<T> promise );
+
+} // namespace Detail
+
+// lazy coroutine. Nothing runs until it is awaited by another coroutine or started on an executor.
+// Futures awaited inside resume on the executor the outermost task was started on
+template <typename T>
+class [[nodiscard]] CoTask
+{
+public:
+	using ValueType = T;
+
+	struct promise_type : Detail::CoTaskPromise<T>
+	{
+		CoTask get_return_object() noexcept
+		{
+			return CoTask( std::coroutine_handle<promise_type>::from_promise( *this ) );
+		}
+	};
+
+	CoTask() noexcept = default;
+
+	CoTask( CoTask&& other ) noexcept : m_handle( std::exchange( other.m_handle, nullptr ) ) {}
+
+	CoTask& operator=( CoTask&& other ) noexcept
+	{
+		CoTask( std::move( other ) ).Swap( *this );
+		return *this;
+	}
+
+	~CoTask()
+	{
+		if ( m_handle )
+			m_handle.destroy();
+	}
+
+	bool Valid() const noexcept
+	{
+		return static_cast<bool>( m_handle );
+	}
+
+	void Swap( CoTask& other ) noexcept
+	{
+		std::swap( m_handle, other.m_handle );
+	}
+
+	auto operator co_await() && noexcept
+	{
+		return Awaiter<false>( m_handle );
+	}
+
+	// runs the task on exec. The returned future holds the result
+	template <typename Exec>
+	Future<T> Start( const Exec& exec ) &&
+	{
+		dbAssert( m_handle );
+		auto[ future, promise ] = MakeFuturePromisePair<T>();
+		Detail::StartCoTask( exec, std::move( *this ), std::move( promise ) );
+		return std::move( future );
+	}
+
+private:
+	explicit CoTask( std::coroutine_handle<promise_type> handle ) noexcept : m_handle( handle ) {}
+
+	// ReturnExpected lets the root hand errors to its promise without rethrowing them
+	template <bool ReturnExpected>
+	class Awaiter
+	{
+	public:
+		explicit Awaiter( std::coroutine_handle<promise_type> handle ) noexcept : m_handle( handle )
+		{
+			dbAssert( m_handle );
+		}
+
+		bool await_ready() const noexcept { return false; }
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> awaiting ) noexcept
+		{
+			m_handle.promise().SetContinuation( awaiting, Detail::GetCoScheduler( awaiting ) );
+			return m_handle;
+		}
+
+		decltype( auto ) await_resume()
+		{
+			if constexpr ( ReturnExpected )
+			{
+				return Expected<T>( std::move( m_handle.promise().GetResult() ) );
+			}
+			else
+			{
+				auto&& result = m_handle.promise().GetResult();
+				if ( !result.has_value() )
+					std::rethrow_exception( result.error() );
+
+				if constexpr ( !std::is_void_v<T> )
+					return T( std::move( result ).value() );
+			}
+		}
+
+	private:
+		std::coroutine_handle<promise_type> m_handle;
+	};
+
+	template <typename U, typename Exec>
+	friend Detail::CoRoot Detail::StartCoTask( const Exec&, CoTask<U>, Promise<U> );
+
+private:
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace Detail
+{
+
+template <typename T, typename Exec>
+CoRoot StartCoTask( const Exec&, CoTask<T> task, Promise<T> promise )
+{
+	promise.SetExpected( co_await typename CoTask<T>::template Awaiter<true>( task.m_handle ) );
+}
+
+} // namespace Detail
+
+namespace Detail
+{
+
+template <typename Exec>
+struct ResumeOnAwaiter
+{
+	bool await_ready() const noexcept { return false; }
+
+	template <typename Promise>
+	void await_suspend( std::coroutine_handle<Promise> handle )
+	{
+		if constexpr ( std::is_base_of_v<CoPromiseBase, Promise> )
+			handle.promise().SetScheduler( executor );
+
+		Threading::Execute( executor, [ handle ] { handle.resume(); } );
+	}
+
+	void await_resume() const noexcept {}
+
+	Exec executor;
+};
+
+} // namespace Detail
+
+// moves the rest of the coroutine onto exec. Futures it awaits afterwards resume on exec too
+template <typename Exec>
+auto ResumeOn( const Exec& exec )
+{
+	return Detail::ResumeOnAwaiter<Exec>{ exec };
+}
+
+template <typename T>
+auto operator co_await( Future<T>&& future )
+{
+	return Detail::FutureAwaiter<T, false>( std::exchange( Detail::FutureAccess::GetState( future ), nullptr ) );
+}
+
+template <typename T>
+auto operator co_await( const SharedFuture<T>& future )
+{
+	return Detail::FutureAwaiter<T, true>( Detail::FutureAccess::GetState( future ) );
+}
+
+template <typename T, typename Exec>
+auto operator co_await( ContinuableFuture<T, Exec>&& future )
+{
+	return Detail::FutureAwaiter<T, false, Exec>( std::exchange( Detail::FutureAccess::GetState( future ), nullptr ), future.GetExecutor() );
+}
+
+template <typename T, typename Exec>
+auto operator co_await( const ContinuableSharedFuture<T, Exec>& future )
+{
+	return Detail::FutureAwaiter<T, true, Exec>( Detail::FutureAccess::GetState( future ), future.GetExecutor() );
+}
+
+} // namespace Threading
+
+#endif
@@ -3,6 +3,9 @@
 #include <stdx/functional.h>
 #include <stdx/type_traits.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace Threading
 {
 
@@ -14,6 +17,8 @@ struct InlineExecutor
 		std::invoke( std::forward<Function>( f ), std::forward<Args>( args )... );
 	}
 
+	constexpr size_t GetConcurrency() const noexcept { return 1; }
+
 	constexpr bool operator==( const InlineExecutor& ) const noexcept { return true; }
 	constexpr bool operator!=( const InlineExecutor& ) const noexcept { return false; }
 };
@@ -25,6 +30,9 @@ namespace Detail
 
 	template <typename Exec, typename Function, typename... Args>
 	using TwoWayExecuteType = decltype( std::declval<const Exec>().TwoWayExecute( std::declval<Function>(), std::declval<Args>()... ) );
+
+	template <typename Exec>
+	using GetConcurrencyType = decltype( std::declval<const Exec>().GetConcurrency() );
 }
 
 template<typename Exec, typename Function, typename... Args>
@@ -36,6 +44,16 @@ inline constexpr bool HasTwoWayExecute_v = stdx::is_detected_v<Detail::TwoWayExe
 template <typename T, typename... Args>
 inline constexpr bool HasInvokeOperator_v = stdx::is_detected_v<std::invoke_result_t, T, Args...>;
 
+// number of tasks the executor can run at the same time. Executors without GetConcurrency() are assumed to use every core
+template <typename Executor>
+inline size_t GetConcurrency( const Executor& exec ) noexcept
+{
+	if constexpr ( stdx::is_detected_v<Detail::GetConcurrencyType, Executor> )
+		return std::max<size_t>( exec.GetConcurrency(), 1 );
+	else
+		return std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+}
+
 template <typename Executor, typename Function, typename... Args>
 inline void Execute( const Executor& exec, Function&& f, Args&&... args )
 {
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdx/unique_function.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Threading
+{
+
+struct FiberOptions
+{
+	// usable stack per fiber. On Linux a guard page below it turns an overflow into a crash instead of corruption
+	size_t stackSize = 256 * 1024;
+
+	// finished fibers each worker keeps for reuse
+	size_t maxPooledFibers = 32;
+};
+
+namespace Detail
+{
+
+// a user mode thread with its own stack. Runs one task at a time and is reused for the next one.
+// Uses Windows fibers or ucontext with mmap'd stacks on Linux
+class Fiber
+{
+public:
+	using Task = stdx::unique_function<void()>;
+
+	// returns nullptr if fibers are not supported or the stack could not be allocated
+	static Fiber* Create( size_t stackSize, void* userData );
+
+	~Fiber();
+
+	Fiber( const Fiber& ) = delete;
+	Fiber& operator=( const Fiber& ) = delete;
+
+	void SetTask( Task task, int priority )
+	{
+		m_task = std::move( task );
+		m_priority = priority;
+		m_finished = false;
+	}
+
+	// runs the fiber on the calling thread until its task finishes or it suspends. Returns true once finished
+	bool Resume();
+
+	void* GetUserData() const noexcept { return m_userData; }
+	int GetPriority() const noexcept { return m_priority; }
+
+	// what the fiber suspended on. Valid after Resume() returns false
+	const std::atomic<uint32_t>* GetParkValue() const noexcept { return m_parkValue; }
+	uint32_t GetParkOld() const noexcept { return m_parkOld; }
+
+	// entry point handed to the platform context
+	static void Start( Fiber* fiber );
+
+private:
+	Fiber() = default;
+
+	void Run();
+	void Suspend();
+
+	friend bool SuspendFiber( const std::atomic<uint32_t>&, uint32_t );
+
+private:
+	Task m_task;
+	void* m_userData = nullptr;
+	int m_priority = 0;
+	bool m_finished = true;
+
+	const std::atomic<uint32_t>* m_parkValue = nullptr;
+	uint32_t m_parkOld = 0;
+
+	// platform context. Opaque so the header stays free of system includes
+	void* m_context = nullptr;
+	void* m_returnContext = nullptr;
+	void* m_stack = nullptr;
+	size_t m_stackMappingSize = 0;
+};
+
+// true while the calling code runs on a pool fiber
+bool IsRunningOnFiber() noexcept;
+
+// suspends the current fiber until value is notified while != old. Returns false if not running on a fiber
+bool SuspendFiber( const std::atomic<uint32_t>& value, uint32_t old );
+
+} // namespace Detail
+
+} // namespace Threading
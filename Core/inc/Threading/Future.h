@@ -10,6 +10,15 @@
 #include <stdx/container.h>
 #include <stdx/functional.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <variant>
+#include <vector>
+
 namespace Threading
 {
 
@@ -175,7 +184,7 @@ template <typename T>
 struct IsFutureRValue : std::conjunction<IsFuture<std::decay_t<T>>, std::is_rvalue_reference<T>, std::negation<std::is_const<T>>> {};
 
 template <typename T>
-inline constexpr bool IsFutureRValue_v = IsFutureRValue::value;
+inline constexpr bool IsFutureRValue_v = IsFutureRValue<T>::value;
 
 template <typename T>
 struct IsVoidFuture : std::false_type {};
@@ -195,11 +204,26 @@ struct IsVoidFuture<ContinuableSharedFuture<void, Exec>> : std::true_type {};
 template <typename T>
 inline constexpr bool IsVoidFuture_v = IsVoidFuture<T>::value;
 
+template <typename T>
+struct WhenAnyResult
+{
+	size_t index;
+	Expected<T> result;
+};
+
 // future implementation
 
 namespace Detail
 {
 
+struct FutureAccess
+{
+	template <typename FutureType>
+	static auto& GetState( FutureType& future ) noexcept
+	{
+		return future.m_state;
+	}
+};
 
 template <typename T>
 class [[nodiscard]] BaseFuture
@@ -213,7 +237,7 @@ public:
 	BaseFuture( const BaseFuture& ) noexcept = default;
 	BaseFuture( BaseFuture&& ) noexcept = default;
 
-	explicit BaseFuture( std::shared_ptr<StateType> state ) noexcept : m_state( std::move( state ) ) {}
+	explicit BaseFuture( Detail::SharedStatePtr<T> state ) noexcept : m_state( std::move( state ) ) {}
 
 	~BaseFuture()
 	{
@@ -240,6 +264,23 @@ public:
 		m_state->Wait();
 	}
 
+	// returns false if the future is still not ready when the timeout expires
+	template <typename Rep, typename Period>
+	bool WaitFor( const std::chrono::duration<Rep, Period>& timeout ) const noexcept
+	{
+		return WaitUntil( Detail::WaitClock::now() + std::chrono::duration_cast<Detail::WaitClock::duration>( timeout ) );
+	}
+
+	template <typename Clock, typename Duration>
+	bool WaitUntil( const std::chrono::time_point<Clock, Duration>& deadline ) const noexcept
+	{
+		dbAssert( m_state );
+		if constexpr ( std::is_same_v<Clock, Detail::WaitClock> )
+			return m_state->WaitUntil( std::chrono::time_point_cast<Detail::WaitClock::duration>( deadline ) );
+		else
+			return WaitFor( deadline - Clock::now() );
+	}
+
 	bool IsReady() const noexcept
 	{
 		dbAssert( m_state );
@@ -247,7 +288,9 @@ public:
 	}
 
 protected:
-	std::shared_ptr<StateType> m_state;
+	Detail::SharedStatePtr<T> m_state;
+
+	friend struct FutureAccess;
 };
 
 }
@@ -267,10 +310,11 @@ public:
 	Future( Future&& ) = default;
 	Future& operator=( Future&& ) = default;
 
-	decltype( auto ) Get() &&
+	T Get() &&
 	{
 		this->Wait();
-		return std::move( *std::exchange( this->m_state, nullptr ) ).Get();
+		auto state = std::exchange( this->m_state, nullptr );
+		return std::move( *state ).Get();
 	}
 
 	SharedFuture<T> Share() && noexcept;
@@ -280,6 +324,9 @@ public:
 
 	template <typename U = T, std::enable_if_t<IsFuture_v<U>, int> = 0>
 	auto Unwrap() && -> RemoveExecutor_t<U>;
+
+	// defined in TimerWheel.h
+	Future WithTimeout( std::chrono::nanoseconds timeout ) &&;
 };
 
 template <typename T>
@@ -309,10 +356,11 @@ public:
 
 	using Detail::BaseFuture<T>::BaseFuture;
 
-	decltype( auto ) Get() &&
+	T Get() &&
 	{
 		this->Wait();
-		return std::exchange( this->m_state, nullptr )->Get();
+		auto state = std::exchange( this->m_state, nullptr );
+		return std::as_const( *state ).Get();
 	}
 
 	template <typename Exec>
@@ -349,26 +397,26 @@ SharedFuture<T> Future<T>::Share() && noexcept
 template<typename T, typename... Args>
 inline Future<T> MakeReadyFuture( Args&&... args )
 {
-	return Future<T>( std::make_shared<Detail::SharedState<T>>( std::forward<Args>( args )... ) );
+	return Future<T>( Detail::MakeSharedState<T>( std::forward<Args>( args )... ) );
 }
 
 template<typename T, typename... Args>
 inline SharedFuture<T> MakeReadySharedFuture( Args&&... args )
 {
-	return SharedFuture<T>( std::make_shared<Detail::SharedState<T>>( std::forward<Args>( args )... ) );
+	return SharedFuture<T>( Detail::MakeSharedState<T>( std::forward<Args>( args )... ) );
 }
 
 template <typename T>
 inline std::pair<Future<T>, Promise<T>> MakeFuturePromisePair()
 {
-	auto state = std::make_shared<Detail::SharedState<T>>();
+	auto state = Detail::MakeSharedState<T>();
 	return std::make_pair( Future<T>( state ), Promise<T>( state ) );
 }
 
 template <typename T>
 inline std::pair<SharedFuture<T>, Promise<T>> MakeSharedFuturePromisePair()
 {
-	auto state = std::make_shared<Detail::SharedState<T>>();
+	auto state = Detail::MakeSharedState<T>();
 	return std::make_pair( SharedFuture<T>( state ), Promise<T>( state ) );
 }
 
@@ -385,7 +433,7 @@ public:
 	static_assert( !std::is_reference_v<Exec> );
 
 public:
-	BaseContinuableFuture( std::shared_ptr<SharedState<ValueType>> state, const Exec& exec )
+	BaseContinuableFuture( SharedStatePtr<ValueType> state, const Exec& exec )
 		: FutureBase( std::move( state ) )
 		, m_executor( exec )
 	{}
@@ -410,11 +458,22 @@ public:
 			return std::move( *this ).Then( std::forward<Function>( f ) );
 	}
 
+	// continuations attached after this are skipped once the token is cancelled and fail with CancelledError
+	auto WithCancellation( CancellationToken token ) &&
+	{
+		return FutureBase( std::move( this->m_state ) ).Via( CancellableExecutor( m_executor, std::move( token ) ) );
+	}
+
 	operator FutureBase() &&
 	{
 		return FutureBase( std::move( this->m_state ) );
 	}
 
+	const Exec& GetExecutor() const noexcept
+	{
+		return m_executor;
+	}
+
 protected:
 	Exec m_executor;
 };
@@ -503,96 +562,422 @@ void WaitAll( InputIt first, InputIt last ) noexcept
 		first->Wait();
 }
 
-/*
-
-template <typename... Futures>
-using FutureTuple = std::tuple<FutureValueType_t<std::decay_t<Futures>>...>;
+// Combinators. Each one attaches a single continuation per input future to a shared countdown
+// and writes into pre-sized storage, so no intermediate futures are created
 
-template <typename HeadFuture, typename... TailFutures, STDX_requires( IsFutureReference_v<HeadFuture> && std::conjunction_v<IsFutureReference<TailFutures>...> )
-Future<FutureTuple<HeadFuture, TailFutures...>> WhenAll( HeadFuture&& headFuture, TailFutures&&... tailFutures )
+namespace Detail
 {
-	static_assert( sizeof...( TailFutures ) > 0 );
-	static_assert( IsFutureRValue_v<HeadFuture&&> && std::conjunction_v<IsFutureRValue<TailFutures&&>...>, "futures must be moved into WhenAll()" );
 
-	WhenAll( std::forward<TailFutures>( tailFutures )... ).Via( InlineExecutor() )
-		.Then( [ headFuture = std::move( headFuture ) ]( FutureTuple<TailFutures...> values )
-			{
-				if constexpr ( IsVoidFuture_v<HeadFuture> )
-					return headFuture.Via( InlineExecutor() ).Then( [ values = std::move( values ) ]()
-						{
-							return std::move( values );
-						} );
-				else
-					return headFuture.Via( InlineExecutor() ).Then( [ values = std::move( values ) ]( FutureValueType_t<HeadFuture> value )
-						{
-							return std::tuple_cat( std::tie( std::move(  value ) ), std::move( values ) );
-						} );
-			} )
-		.Unwrap();
+template <typename T>
+using NonVoid_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+NonVoid_t<T> TakeValue( Expected<T>& expected, std::true_type /*shared*/ )
+{
+	if constexpr ( std::is_void_v<T> )
+		return {};
+	else
+		return expected.value();
 }
 
-template <typename HeadFuture, STDX_requires( IsFutureReference_v<HeadFuture&&> )
-Future<FutureTuple<HeadFuture>> WhenAll( HeadFuture&& headFuture )
+template <typename T>
+NonVoid_t<T> TakeValue( Expected<T>& expected, std::false_type /*shared*/ )
 {
-	static_assert( IsFutureRValue_v<HeadFuture&&>, "futures must be moved into WhenAll()" );
-	if constexpr ( IsVoidFuture_v<HeadFuture> )
-		return headFuture.Via( InlineExecutor() ).Then( []( FutureValueType_t<HeadFuture> value ) { return std::make_tuple( std::move( value ) ); } );
+	if constexpr ( std::is_void_v<T> )
+		return {};
 	else
-		return headFuture.Via( InlineExecutor() ).Then( [] { return std::tuple<>(); } );
+		return std::move( expected ).value();
+}
+
+template <typename T>
+Expected<T> TakeExpected( Expected<T>& expected, std::true_type /*shared*/ )
+{
+	return expected;
 }
 
-Future<std::tuple<>> WhenAll()
+template <typename T>
+Expected<T> TakeExpected( Expected<T>& expected, std::false_type /*shared*/ )
 {
-	return MakeReadyFuture<std::tuple<>>();
+	return std::move( expected );
 }
 
-template <typename Container>
-using FutureVector = std::vector<FutureValueType_t<typename stdx::container_traits<Container>::value_type>>;
+// attaches f( Expected<T>& ) straight to the future's shared state and releases the future
+template <typename FutureType, typename Function>
+void OnReady( FutureType& future, Function&& f )
+{
+	auto state = std::exchange( FutureAccess::GetState( future ), nullptr );
+	dbAssert( state );
+	state->SetContinuation( std::forward<Function>( f ) );
+}
 
 template <typename Container>
-Future<FutureVector<Container>> WhenAll( Container&& container )
+using ContainerFuture_t = std::decay_t<decltype( *std::begin( std::declval<Container&>() ) )>;
+
+template <typename T>
+class WhenAllState
+{
+public:
+	using ResultType = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+
+	WhenAllState( size_t count, Promise<ResultType> promise )
+		: m_remaining( count )
+		, m_values( std::is_void_v<T> ? 0 : count )
+		, m_promise( std::move( promise ) )
+	{}
+
+	template <typename Shared>
+	void SetResult( size_t index, Expected<T>& expected, Shared shared )
+	{
+		if ( expected.has_value() )
+		{
+			if constexpr ( !std::is_void_v<T> )
+				m_values[ index ].emplace( TakeValue( expected, shared ) );
+		}
+		else if ( !m_failed.exchange( true, std::memory_order_acq_rel ) )
+		{
+			m_promise.SetError( expected.error() );
+		}
+
+		if ( m_remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 && !m_failed.load( std::memory_order_acquire ) )
+		{
+			if constexpr ( std::is_void_v<T> )
+			{
+				m_promise.SetValue();
+			}
+			else
+			{
+				std::vector<T> values;
+				values.reserve( m_values.size() );
+				for ( auto& value : m_values )
+					values.push_back( std::move( *value ) );
+
+				m_promise.SetValue( std::move( values ) );
+			}
+		}
+	}
+
+private:
+	std::atomic<size_t> m_remaining;
+	std::atomic<bool> m_failed = false;
+	std::vector<std::optional<NonVoid_t<T>>> m_values;
+	Promise<ResultType> m_promise;
+};
+
+template <typename... Ts>
+class WhenAllTupleState
+{
+public:
+	using ResultType = std::tuple<NonVoid_t<Ts>...>;
+
+	explicit WhenAllTupleState( Promise<ResultType> promise ) : m_promise( std::move( promise ) ) {}
+
+	template <size_t I, typename T, typename Shared>
+	void SetResult( Expected<T>& expected, Shared shared )
+	{
+		if ( expected.has_value() )
+			std::get<I>( m_values ).emplace( TakeValue( expected, shared ) );
+		else if ( !m_failed.exchange( true, std::memory_order_acq_rel ) )
+			m_promise.SetError( expected.error() );
+
+		if ( m_remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 && !m_failed.load( std::memory_order_acquire ) )
+		{
+			m_promise.SetValue( std::apply( []( auto&... values ) { return ResultType( std::move( *values )... ); }, m_values ) );
+		}
+	}
+
+private:
+	std::atomic<size_t> m_remaining = sizeof...( Ts );
+	std::atomic<bool> m_failed = false;
+	std::tuple<std::optional<NonVoid_t<Ts>>...> m_values;
+	Promise<ResultType> m_promise;
+};
+
+template <typename T>
+class WhenNState
 {
-	static_assert( std::is_rvalue_reference_v<Container>, "futures must be moved into WhenAll()" );
+public:
+	WhenNState( size_t count, Promise<std::vector<WhenAnyResult<T>>> promise )
+		: m_count( count )
+		, m_results( count )
+		, m_promise( std::move( promise ) )
+	{}
 
-	if ( !std::empty( container ) )
+	template <typename Shared>
+	void SetResult( size_t index, Expected<T>& expected, Shared shared )
 	{
-		using ValueType = FutureValueType_t<typename stdx::container_traits<Container>::value_type>;
+		const size_t slot = m_claimed.fetch_add( 1, std::memory_order_relaxed );
+		if ( slot >= m_count )
+			return;
 
-		auto vectorFuture = std::move( *std::begin( container ) ).Via( InlineExecutor() )
-			.Then( [ initSize = std::size( container ) ]( ValueType value )
-				{
-					FutureVector<Container> results;
-					results.reserve( initSize );
-					results.emplace( std::move( value ) );
-					return results;
-				} );
+		m_results[ slot ].emplace( WhenAnyResult<T>{ index, TakeExpected( expected, shared ) } );
 
-		for ( auto it = ++std::begin( container ), last = std::end( container ); it != last; ++it )
+		if ( m_filled.fetch_add( 1, std::memory_order_acq_rel ) + 1 == m_count )
 		{
-			vectorFuture = std::move( vectorFuture )
-				.Then( [ nextFuture = std::move( *it ) ]( FutureVector<Container> results )
-					{
-						return nextFuture.Via( InlineExecutor() ).Then( [ results = std::move( results ) ]( ValueType value ) mutable
-							{
-								results.emplace_back( std::move( value ) );
-								return std::move( results );
-							} );
-					} )
-				.Unwrap();
+			std::vector<WhenAnyResult<T>> results;
+			results.reserve( m_count );
+			for ( auto& result : m_results )
+				results.push_back( std::move( *result ) );
+
+			m_promise.SetValue( std::move( results ) );
 		}
+	}
+
+private:
+	const size_t m_count;
+	std::atomic<size_t> m_claimed = 0;
+	std::atomic<size_t> m_filled = 0;
+	std::vector<std::optional<WhenAnyResult<T>>> m_results;
+	Promise<std::vector<WhenAnyResult<T>>> m_promise;
+};
+
+template <typename T>
+class WhenAnyState
+{
+public:
+	explicit WhenAnyState( Promise<WhenAnyResult<T>> promise ) : m_promise( std::move( promise ) ) {}
 
-		return vectorFuture;
+	template <typename Shared>
+	void SetResult( size_t index, Expected<T>& expected, Shared shared )
+	{
+		if ( !m_done.exchange( true, std::memory_order_acq_rel ) )
+			m_promise.SetValue( WhenAnyResult<T>{ index, TakeExpected( expected, shared ) } );
 	}
-	else
+
+private:
+	std::atomic<bool> m_done = false;
+	Promise<WhenAnyResult<T>> m_promise;
+};
+
+template <typename State, typename Container>
+void AttachAll( const std::shared_ptr<State>& state, Container& container )
+{
+	using FutureType = ContainerFuture_t<Container>;
+	using T = typename FutureType::ValueType;
+	using Shared = std::bool_constant<IsSharedFuture_v<FutureType>>;
+
+	size_t index = 0;
+	for ( auto& future : container )
 	{
-		return MakeReadyFuture<FutureVector<Container>>();
+		OnReady( future, [ state, index ]( Expected<T>& expected )
+			{
+				state->SetResult( index, expected, Shared{} );
+			} );
+		++index;
+	}
+}
+
+template <typename State, typename... Futures, size_t... Is>
+void AttachAllTuple( const std::shared_ptr<State>& state, std::index_sequence<Is...>, Futures&... futures )
+{
+	( OnReady( futures, [ state ]( Expected<typename Futures::ValueType>& expected )
+		{
+			using Shared = std::bool_constant<IsSharedFuture_v<Futures>>;
+			state->template SetResult<Is>( expected, Shared{} );
+		} ), ... );
+}
+
+} // namespace Detail
+
+// completes with every value in input order, or with the first error
+template <typename Container, std::enable_if_t<!IsFuture_v<std::decay_t<Container>>, int> = 0>
+auto WhenAll( Container&& container )
+{
+	static_assert( !std::is_lvalue_reference_v<Container>, "futures must be moved into WhenAll()" );
+
+	using T = typename Detail::ContainerFuture_t<Container>::ValueType;
+	using State = Detail::WhenAllState<T>;
+	using ResultType = typename State::ResultType;
+
+	const size_t count = static_cast<size_t>( std::distance( std::begin( container ), std::end( container ) ) );
+	if ( count == 0 )
+	{
+		if constexpr ( std::is_void_v<T> )
+			return MakeReadyFuture<void>();
+		else
+			return MakeReadyFuture<ResultType>( ResultType() );
+	}
+
+	auto[ future, promise ] = MakeFuturePromisePair<ResultType>();
+	Detail::AttachAll( std::make_shared<State>( count, std::move( promise ) ), container );
+	return std::move( future );
+}
+
+// completes with a tuple of every value ( std::monostate for void futures ), or with the first error
+template <typename... Futures, std::enable_if_t<( sizeof...( Futures ) > 0 ) && std::conjunction_v<IsFuture<std::decay_t<Futures>>...>, int> = 0>
+auto WhenAll( Futures&&... futures )
+{
+	static_assert( std::conjunction_v<IsFutureRValue<Futures&&>...>, "futures must be moved into WhenAll()" );
+
+	using State = Detail::WhenAllTupleState<typename std::decay_t<Futures>::ValueType...>;
+
+	auto[ future, promise ] = MakeFuturePromisePair<typename State::ResultType>();
+	Detail::AttachAllTuple( std::make_shared<State>( std::move( promise ) ), std::index_sequence_for<Futures...>{}, futures... );
+	return std::move( future );
+}
+
+inline Future<std::tuple<>> WhenAll()
+{
+	return MakeReadyFuture<std::tuple<>>();
+}
+
+// completes with the first n results in completion order. Errors count as results
+template <typename Container, std::enable_if_t<!IsFuture_v<std::decay_t<Container>>, int> = 0>
+auto WhenN( size_t n, Container&& container )
+{
+	static_assert( !std::is_lvalue_reference_v<Container>, "futures must be moved into WhenN()" );
+
+	using T = typename Detail::ContainerFuture_t<Container>::ValueType;
+	using ResultType = std::vector<WhenAnyResult<T>>;
+
+	const size_t count = static_cast<size_t>( std::distance( std::begin( container ), std::end( container ) ) );
+	dbAssert( n <= count );
+	n = std::min( n, count );
+
+	if ( n == 0 )
+		return MakeReadyFuture<ResultType>( ResultType() );
+
+	auto[ future, promise ] = MakeFuturePromisePair<ResultType>();
+	Detail::AttachAll( std::make_shared<Detail::WhenNState<T>>( n, std::move( promise ) ), container );
+	return std::move( future );
+}
+
+// completes with the first result to arrive and its index. Errors count as results.
+// Fails with std::invalid_argument if the container is empty, since nothing could ever complete it
+template <typename Container, std::enable_if_t<!IsFuture_v<std::decay_t<Container>>, int> = 0>
+auto WhenAny( Container&& container )
+{
+	static_assert( !std::is_lvalue_reference_v<Container>, "futures must be moved into WhenAny()" );
+
+	using T = typename Detail::ContainerFuture_t<Container>::ValueType;
+
+	auto[ future, promise ] = MakeFuturePromisePair<WhenAnyResult<T>>();
+	if ( std::begin( container ) == std::end( container ) )
+	{
+		promise.SetError( std::make_exception_ptr( std::invalid_argument( "WhenAny() of no futures" ) ) );
+		return std::move( future );
 	}
+
+	Detail::AttachAll( std::make_shared<Detail::WhenAnyState<T>>( std::move( promise ) ), container );
+	return std::move( future );
+}
+
+// completes with the index of the first future to become ready. Values of heterogeneous futures are discarded
+template <typename... Futures, std::enable_if_t<( sizeof...( Futures ) > 0 ) && std::conjunction_v<IsFuture<std::decay_t<Futures>>...>, int> = 0>
+Future<size_t> WhenAny( Futures&&... futures )
+{
+	static_assert( std::conjunction_v<IsFutureRValue<Futures&&>...>, "futures must be moved into WhenAny()" );
+
+	struct State
+	{
+		explicit State( Promise<size_t> p ) : promise( std::move( p ) ) {}
+
+		std::atomic<bool> done = false;
+		Promise<size_t> promise;
+	};
+
+	auto[ future, promise ] = MakeFuturePromisePair<size_t>();
+	auto state = std::make_shared<State>( std::move( promise ) );
+
+	size_t index = 0;
+	( Detail::OnReady( futures, [ state, i = index++ ]( auto& )
+		{
+			if ( !state->done.exchange( true, std::memory_order_acq_rel ) )
+				state->promise.SetValue( i );
+		} ), ... );
+
+	return std::move( future );
 }
 
-*/
+namespace Detail
+{
+
+// completes the batch future once every task has run or been dropped
+struct BatchState
+{
+	explicit BatchState( Promise<void> p ) : promise( std::move( p ) ) {}
+
+	void Finish( Error e )
+	{
+		if ( e && !failed.exchange( true, std::memory_order_acq_rel ) )
+			error = std::move( e );
+
+		if ( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+		{
+			if ( failed.load( std::memory_order_acquire ) )
+				promise.SetError( std::move( error ) );
+			else
+				promise.SetValue();
+		}
+	}
+
+	std::atomic<size_t> remaining = 0;
+	std::atomic<bool> failed = false;
+	Error error;
+	Promise<void> promise;
+};
+
+template <typename Function>
+class BatchTask
+{
+public:
+	BatchTask( std::shared_ptr<BatchState> state, Function f ) : m_state( std::move( state ) ), m_function( std::move( f ) ) {}
+
+	BatchTask( BatchTask&& ) = default;
+	BatchTask& operator=( BatchTask&& ) = default;
+
+	~BatchTask()
+	{
+		if ( m_state && ClaimDroppedTask() )
+			std::exchange( m_state, nullptr )->Finish( std::make_exception_ptr( CancelledError() ) );
+	}
+
+	void operator()() noexcept
+	{
+		Error error;
+		try
+		{
+			std::invoke( std::move( m_function ) );
+		}
+		catch ( ... )
+		{
+			error = std::current_exception();
+		}
+
+		std::exchange( m_state, nullptr )->Finish( std::move( error ) );
+	}
+
+private:
+	std::shared_ptr<BatchState> m_state;
+	Function m_function;
+};
+
+} // namespace Detail
+
+template <typename Range>
+Future<void> ThreadPool::QueueTasksWithFuture( Range&& functions, Priority priority )
+{
+	auto[ future, promise ] = MakeFuturePromisePair<void>();
+	auto state = std::make_shared<Detail::BatchState>( std::move( promise ) );
+
+	stdx::small_vector<Task, 64> tasks;
+	for ( auto&& f : functions )
+		tasks.emplace_back( Detail::BatchTask<std::decay_t<decltype( f )>>( state, std::forward<decltype( f )>( f ) ) );
+
+	if ( tasks.empty() )
+	{
+		state->promise.SetValue();
+		return std::move( future );
+	}
+
+	state->remaining.store( tasks.size(), std::memory_order_relaxed );
+	QueueTasks( tasks.data(), tasks.size(), priority );
+	return std::move( future );
+}
 
 } // namespace Threading
 
+#include "TimerWheel.h"
+
 namespace MT
 {
 	using namespace Threading;
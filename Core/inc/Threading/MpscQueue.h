@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdx/assert.h>
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace Threading
+{
+
+// unbounded lock free multi producer single consumer queue ( Vyukov ). Push is wait free.
+// TryPop can briefly report empty while a producer is between its exchange and its link, so callers that know
+// an item is coming have to retry
+template <typename T>
+class MpscQueue
+{
+public:
+	MpscQueue() : m_head( new Node() ), m_tail( m_head.load( std::memory_order_relaxed ) ) {}
+
+	MpscQueue( const MpscQueue& ) = delete;
+	MpscQueue& operator=( const MpscQueue& ) = delete;
+
+	~MpscQueue()
+	{
+		for ( Node* node = m_tail; node; )
+			delete std::exchange( node, node->next.load( std::memory_order_relaxed ) );
+	}
+
+	template <typename... Args>
+	void Push( Args&&... args )
+	{
+		auto* node = new Node();
+		node->value.emplace( std::forward<Args>( args )... );
+
+		Node* previous = m_head.exchange( node, std::memory_order_acq_rel );
+		previous->next.store( node, std::memory_order_release );
+	}
+
+	// consumer only
+	bool TryPop( T& value )
+	{
+		Node* tail = m_tail;
+		Node* next = tail->next.load( std::memory_order_acquire );
+		if ( next == nullptr )
+			return false;
+
+		// next becomes the new stub
+		value = std::move( *next->value );
+		next->value.reset();
+		m_tail = next;
+		delete tail;
+		return true;
+	}
+
+	// consumer only. May return true while a push is still being linked
+	bool Empty() const noexcept
+	{
+		return m_tail->next.load( std::memory_order_acquire ) == nullptr;
+	}
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next = nullptr;
+		std::optional<T> value;
+	};
+
+	// producers swap themselves in at the head, the consumer pops from the tail
+	alignas( 64 ) std::atomic<Node*> m_head;
+	alignas( 64 ) Node* m_tail;
+};
+
+} // namespace Threading
@@ -0,0 +1,496 @@
+#pragma once
+
+#include "AtomicWait.h"
+#include "Execution.h"
+
+#include <stdx/assert.h>
+#include <stdx/unique_function.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Threading
+{
+
+struct PipelineStageOptions
+{
+	// items waiting to start. A full queue stops the stage above it
+	size_t capacity = 16;
+
+	// items processed at the same time. An item whose output has no room downstream keeps its slot
+	size_t concurrency = 1;
+};
+
+struct PipelineStageStats
+{
+	std::string name;
+	size_t capacity = 0;
+	size_t concurrency = 0;
+
+	size_t queued = 0;
+	size_t peakQueued = 0;
+	size_t running = 0;
+
+	// finished items waiting for room in the next stage
+	size_t blocked = 0;
+
+	uint64_t processed = 0;
+	uint64_t failed = 0;
+
+	// processed items per second since the stage first started an item
+	double throughput = 0.0;
+};
+
+namespace Detail
+{
+
+class PipelineCore;
+
+class PipelineStageBase
+{
+public:
+	using Task = stdx::unique_function<void()>;
+
+	PipelineStageBase( std::string name, PipelineStageOptions options )
+		: m_name( std::move( name ) )
+		, m_options( options )
+	{
+		m_options.capacity = std::max<size_t>( m_options.capacity, 1 );
+		m_options.concurrency = std::max<size_t>( m_options.concurrency, 1 );
+	}
+
+	virtual ~PipelineStageBase() = default;
+
+	// called with the pipeline locked. Moves finished outputs downstream and starts queued items.
+	// Started items are handed back so they can be executed after unlocking. Returns true if anything moved
+	virtual bool Pump( std::shared_ptr<PipelineCore>& core, std::vector<Task>& started ) = 0;
+
+	virtual bool IsIdle() const noexcept = 0;
+
+	virtual PipelineStageStats GetStats( WaitClock::time_point now ) const = 0;
+
+protected:
+	std::string m_name;
+	PipelineStageOptions m_options;
+
+	uint64_t m_processed = 0;
+	uint64_t m_failed = 0;
+	size_t m_peakQueued = 0;
+	std::optional<WaitClock::time_point> m_firstStart;
+};
+
+// the typed input queue of a stage
+template <typename T>
+class PipelineInput : public PipelineStageBase
+{
+public:
+	using PipelineStageBase::PipelineStageBase;
+
+	bool HasRoom() const noexcept
+	{
+		return m_queue.size() < m_options.capacity;
+	}
+
+	void Enqueue( T&& item )
+	{
+		m_queue.push_back( std::move( item ) );
+		m_peakQueued = std::max( m_peakQueued, m_queue.size() );
+	}
+
+protected:
+	std::deque<T> m_queue;
+};
+
+class PipelineCore : public std::enable_shared_from_this<PipelineCore>
+{
+public:
+	using Task = PipelineStageBase::Task;
+
+	std::unique_lock<std::mutex> Lock()
+	{
+		return std::unique_lock( m_mutex );
+	}
+
+	// pumps stages from the back so room freed downstream is used upstream in the same pass,
+	// then unlocks and executes everything that was started
+	void PumpAndUnlock( std::unique_lock<std::mutex>& lock )
+	{
+		auto self = shared_from_this();
+		std::vector<Task> started;
+
+		bool progress = true;
+		while ( progress )
+		{
+			progress = false;
+			for ( size_t i = m_stages.size(); i-- > 0; )
+				progress |= m_stages[ i ]->Pump( self, started );
+		}
+
+		lock.unlock();
+
+		for ( auto& task : started )
+			task();
+
+		m_signal.Notify();
+	}
+
+	void AddStage( std::unique_ptr<PipelineStageBase> stage )
+	{
+		std::lock_guard lock( m_mutex );
+		m_stages.push_back( std::move( stage ) );
+	}
+
+	template <typename T>
+	PipelineInput<T>* GetInput() const noexcept
+	{
+		return m_stages.empty() ? nullptr : static_cast<PipelineInput<T>*>( m_stages.front().get() );
+	}
+
+	bool HasStages() const noexcept
+	{
+		return !m_stages.empty();
+	}
+
+	void OnItemPushed() noexcept
+	{
+		m_inFlight.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	// the item left the last stage or failed
+	void OnItemDone() noexcept
+	{
+		m_inFlight.fetch_sub( 1, std::memory_order_release );
+	}
+
+	void SetError( std::exception_ptr error )
+	{
+		std::lock_guard lock( m_mutex );
+		if ( !m_error )
+			m_error = std::move( error );
+	}
+
+	std::exception_ptr TakeError()
+	{
+		std::lock_guard lock( m_mutex );
+		return std::exchange( m_error, nullptr );
+	}
+
+	bool IsIdle() const noexcept
+	{
+		return m_inFlight.load( std::memory_order_acquire ) == 0;
+	}
+
+	template <typename Ready>
+	void Wait( Ready&& ready )
+	{
+		m_signal.Wait( std::forward<Ready>( ready ) );
+	}
+
+	std::vector<PipelineStageStats> GetStats() const
+	{
+		std::lock_guard lock( m_mutex );
+
+		const auto now = WaitClock::now();
+		std::vector<PipelineStageStats> stats;
+		stats.reserve( m_stages.size() );
+		for ( auto& stage : m_stages )
+			stats.push_back( stage->GetStats( now ) );
+
+		return stats;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<PipelineStageBase>> m_stages;
+	std::exception_ptr m_error;
+
+	std::atomic<size_t> m_inFlight = 0;
+	WaitSignal m_signal;
+};
+
+template <typename In, typename Out, typename Exec, typename Function>
+class PipelineStage final : public PipelineInput<In>
+{
+public:
+	PipelineStage( std::string name, PipelineStageOptions options, const Exec& exec, Function f )
+		: PipelineInput<In>( std::move( name ), options )
+		, m_executor( exec )
+		, m_function( std::move( f ) )
+	{}
+
+	void SetNext( PipelineInput<Out>* next ) noexcept
+	{
+		m_next = next;
+	}
+
+	bool Pump( std::shared_ptr<PipelineCore>& core, std::vector<PipelineStageBase::Task>& started ) override
+	{
+		bool progress = false;
+
+		if constexpr ( !std::is_void_v<Out> )
+		{
+			while ( !m_blocked.empty() && m_next->HasRoom() )
+			{
+				m_next->Enqueue( std::move( m_blocked.front() ) );
+				m_blocked.pop_front();
+				progress = true;
+			}
+		}
+
+		while ( !this->m_queue.empty() && m_running + GetBlockedCount() < this->m_options.concurrency )
+		{
+			if ( !this->m_firstStart )
+				this->m_firstStart = WaitClock::now();
+
+			++m_running;
+			started.push_back( [ this, core, item = std::move( this->m_queue.front() ) ]() mutable
+				{
+					Threading::Execute( m_executor, [ this, core = std::move( core ), item = std::move( item ) ]() mutable
+						{
+							Run( *core, std::move( item ) );
+						} );
+				} );
+			this->m_queue.pop_front();
+			progress = true;
+		}
+
+		return progress;
+	}
+
+	bool IsIdle() const noexcept override
+	{
+		return this->m_queue.empty() && m_running == 0 && GetBlockedCount() == 0;
+	}
+
+	PipelineStageStats GetStats( WaitClock::time_point now ) const override
+	{
+		PipelineStageStats stats;
+		stats.name = this->m_name;
+		stats.capacity = this->m_options.capacity;
+		stats.concurrency = this->m_options.concurrency;
+		stats.queued = this->m_queue.size();
+		stats.peakQueued = this->m_peakQueued;
+		stats.running = m_running;
+		stats.blocked = GetBlockedCount();
+		stats.processed = this->m_processed;
+		stats.failed = this->m_failed;
+
+		if ( this->m_firstStart )
+		{
+			const std::chrono::duration<double> elapsed = now - *this->m_firstStart;
+			if ( elapsed.count() > 0 )
+				stats.throughput = static_cast<double>( this->m_processed ) / elapsed.count();
+		}
+
+		return stats;
+	}
+
+private:
+	using Output = std::conditional_t<std::is_void_v<Out>, bool, Out>;
+
+	size_t GetBlockedCount() const noexcept
+	{
+		if constexpr ( std::is_void_v<Out> )
+			return 0;
+		else
+			return m_blocked.size();
+	}
+
+	void Run( PipelineCore& core, In item )
+	{
+		std::optional<Output> output;
+		try
+		{
+			if constexpr ( std::is_void_v<Out> )
+			{
+				std::invoke( m_function, std::move( item ) );
+				output.emplace( true );
+			}
+			else
+			{
+				output.emplace( std::invoke( m_function, std::move( item ) ) );
+			}
+		}
+		catch ( ... )
+		{
+			core.SetError( std::current_exception() );
+		}
+
+		auto lock = core.Lock();
+		--m_running;
+
+		if ( !output )
+		{
+			++this->m_failed;
+			core.OnItemDone();
+		}
+		else
+		{
+			++this->m_processed;
+
+			if constexpr ( !std::is_void_v<Out> )
+			{
+				if ( m_next )
+					m_blocked.push_back( std::move( *output ) );
+				else
+					core.OnItemDone();
+			}
+			else
+			{
+				core.OnItemDone();
+			}
+		}
+
+		core.PumpAndUnlock( lock );
+	}
+
+private:
+	Exec m_executor;
+	Function m_function;
+
+	size_t m_running = 0;
+	PipelineInput<Out>* m_next = nullptr;
+
+	// unused for void stages
+	std::deque<Output> m_blocked;
+};
+
+} // namespace Detail
+
+// a chain of stages, each running on its own executor with a bounded input queue and a fixed number of items in flight.
+// A stage that cannot hand its output on stops taking new items, so a slow stage throttles everything above it
+// and memory use stays bounded. Errors drop the item and are rethrown by WaitIdle().
+// Built front to back:
+//
+//	auto pipeline = Threading::Pipeline<std::string>()
+//		.AddStage( "read", Threading::IOExecutor(), ReadFile, { 8, 4 } )
+//		.AddStage( "decode", Threading::ComputeExecutor(), Decode, { 4, 2 } );
+//
+// The output of the last stage is discarded
+template <typename In, typename Out = In>
+class Pipeline
+{
+public:
+	Pipeline() : m_core( std::make_shared<Detail::PipelineCore>() ) {}
+
+	Pipeline( Pipeline&& ) noexcept = default;
+	Pipeline& operator=( Pipeline&& ) noexcept = default;
+
+	Pipeline( const Pipeline& ) = delete;
+	Pipeline& operator=( const Pipeline& ) = delete;
+
+	// waits for queued items. Errors are not rethrown here
+	~Pipeline()
+	{
+		if ( m_core )
+			m_core->Wait( [ this ] { return m_core->IsIdle(); } );
+	}
+
+	template <typename Exec, typename Function>
+	auto AddStage( std::string name, const Exec& exec, Function&& f, PipelineStageOptions options = {} ) &&
+	{
+		static_assert( !std::is_void_v<Out>, "cannot add a stage after one that returns void" );
+
+		using Next = std::invoke_result_t<std::decay_t<Function>&, Out>;
+		using Stage = Detail::PipelineStage<Out, Next, Exec, std::decay_t<Function>>;
+
+		auto stage = std::make_unique<Stage>( std::move( name ), options, exec, std::forward<Function>( f ) );
+		Stage* added = stage.get();
+		m_core->AddStage( std::move( stage ) );
+
+		if ( m_last )
+			m_last( added );
+
+		Pipeline<In, Next> result( std::move( m_core ) );
+		if constexpr ( !std::is_void_v<Next> )
+			result.m_last = [ added ]( Detail::PipelineInput<Next>* next ) { added->SetNext( next ); };
+
+		return result;
+	}
+
+	// blocks while the first stage is full
+	void Push( In item )
+	{
+		dbAssert( m_core->HasStages() );
+		auto* input = m_core->template GetInput<In>();
+
+		for (;;)
+		{
+			auto lock = m_core->Lock();
+			if ( input->HasRoom() )
+			{
+				m_core->OnItemPushed();
+				input->Enqueue( std::move( item ) );
+				m_core->PumpAndUnlock( lock );
+				return;
+			}
+
+			lock.unlock();
+			m_core->Wait( [ & ]
+				{
+					auto lock = m_core->Lock();
+					return input->HasRoom();
+				} );
+		}
+	}
+
+	// returns false and leaves item alone if the first stage is full
+	bool TryPush( In& item )
+	{
+		dbAssert( m_core->HasStages() );
+		auto* input = m_core->template GetInput<In>();
+
+		auto lock = m_core->Lock();
+		if ( !input->HasRoom() )
+			return false;
+
+		m_core->OnItemPushed();
+		input->Enqueue( std::move( item ) );
+		m_core->PumpAndUnlock( lock );
+		return true;
+	}
+
+	// blocks until every pushed item has left the pipeline, then rethrows the first error since the last call
+	void WaitIdle()
+	{
+		m_core->Wait( [ this ] { return m_core->IsIdle(); } );
+
+		if ( auto error = m_core->TakeError() )
+			std::rethrow_exception( error );
+	}
+
+	bool IsIdle() const noexcept
+	{
+		return m_core->IsIdle();
+	}
+
+	std::vector<PipelineStageStats> GetStats() const
+	{
+		return m_core->GetStats();
+	}
+
+private:
+	explicit Pipeline( std::shared_ptr<Detail::PipelineCore> core ) : m_core( std::move( core ) ) {}
+
+	std::shared_ptr<Detail::PipelineCore> m_core;
+
+	// links the last stage to the one added after it
+	std::function<void( Detail::PipelineInput<Out>* )> m_last;
+
+	template <typename, typename>
+	friend class Pipeline;
+};
+
+} // namespace Threading
@@ -14,7 +14,7 @@ public:
 	using ErrorType = typename StateType::ErrorType;
 	using ExpectedType = typename StateType::ExpectedType;
 
-	explicit Promise( std::shared_ptr<StateType> state ) noexcept : m_state( std::move( state ) ) {}
+	explicit Promise( Detail::SharedStatePtr<T> state ) noexcept : m_state( std::move( state ) ) {}
 
 	bool Valid() const noexcept
 	{
@@ -45,7 +45,7 @@ public:
 	}
 
 protected:
-	std::shared_ptr<StateType> m_state;
+	Detail::SharedStatePtr<T> m_state;
 };
 
 } // namespace Threading
\ No newline at end of file
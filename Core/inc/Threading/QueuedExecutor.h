@@ -0,0 +1,121 @@
+#pragma once
+
+#include "MpscQueue.h"
+
+#include <stdx/assert.h>
+#include <stdx/unique_function.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <thread>
+
+namespace Threading
+{
+
+namespace Detail
+{
+
+class QueuedExecutorState
+{
+public:
+	using Task = stdx::unique_function<void()>;
+
+	template <typename Function>
+	void Post( Function&& f )
+	{
+		m_queue.Push( std::forward<Function>( f ) );
+		m_count.fetch_add( 1, std::memory_order_release );
+	}
+
+	size_t Drain( size_t maxTasks, const std::chrono::steady_clock::time_point* deadline )
+	{
+		dbAssertMessage( !m_draining.exchange( true, std::memory_order_acquire ), "QueuedExecutor drained from two threads at once" );
+
+		// work queued by the tasks themselves waits for the next drain, so a task that reposts cannot stall the caller
+		const size_t available = m_count.load( std::memory_order_acquire );
+		const size_t limit = std::min( maxTasks, available );
+
+		size_t ran = 0;
+		while ( ran < limit )
+		{
+			Task task;
+			while ( !m_queue.TryPop( task ) )
+			{
+				// the count says a task exists, its producer has not linked it yet
+				std::this_thread::yield();
+			}
+
+			m_count.fetch_sub( 1, std::memory_order_relaxed );
+			++ran;
+
+			task();
+
+			if ( deadline && std::chrono::steady_clock::now() >= *deadline )
+				break;
+		}
+
+		m_draining.store( false, std::memory_order_release );
+		return ran;
+	}
+
+	size_t GetPendingCount() const noexcept
+	{
+		return m_count.load( std::memory_order_acquire );
+	}
+
+private:
+	MpscQueue<Task> m_queue;
+	std::atomic<size_t> m_count = 0;
+	std::atomic<bool> m_draining = false;
+};
+
+} // namespace Detail
+
+// queues work for a thread that runs it at a point of its choosing, e.g. the game loop once per frame.
+// Execute() is lock free and can be called from any thread. Only one thread may drain at a time.
+// Copies share the same queue. Tasks still queued when the last copy goes away are destroyed without running
+class QueuedExecutor
+{
+public:
+	QueuedExecutor() : m_state( std::make_shared<Detail::QueuedExecutorState>() ) {}
+
+	template <typename Function>
+	void Execute( Function&& f ) const
+	{
+		m_state->Post( std::forward<Function>( f ) );
+	}
+
+	constexpr size_t GetConcurrency() const noexcept
+	{
+		return 1;
+	}
+
+	// runs up to maxTasks of the tasks queued before the call. Returns the number run
+	size_t Drain( size_t maxTasks = std::numeric_limits<size_t>::max() ) const
+	{
+		return m_state->Drain( maxTasks, nullptr );
+	}
+
+	// like Drain() but stops after the task that crosses the time budget. At least one task runs if any is queued
+	size_t DrainFor( std::chrono::nanoseconds budget, size_t maxTasks = std::numeric_limits<size_t>::max() ) const
+	{
+		const auto deadline = std::chrono::steady_clock::now() + budget;
+		return m_state->Drain( maxTasks, &deadline );
+	}
+
+	size_t GetPendingCount() const noexcept
+	{
+		return m_state->GetPendingCount();
+	}
+
+	bool operator==( const QueuedExecutor& other ) const noexcept { return m_state == other.m_state; }
+	bool operator!=( const QueuedExecutor& other ) const noexcept { return m_state != other.m_state; }
+
+private:
+	std::shared_ptr<Detail::QueuedExecutorState> m_state;
+};
+
+} // namespace Threading
@@ -1,16 +1,31 @@
 #pragma once
 
+#include "AtomicWait.h"
+
 #include <stdx/assert.h>
 #include <stdx/expected.h>
 #include <stdx/type_traits.h>
-#include <stdx/vector_s.h>
+#include <stdx/unique_function.h>
 
-#include <functional>
-#include <mutex>
+#include <atomic>
+#include <optional>
 
 namespace Threading::Detail
 {
 
+template <typename T>
+class SharedState;
+
+// the state word only ever gains bits. Ready is set once the result is written,
+// ContinuationClaimed/ContinuationAttached hand the inline continuation slot between the attaching and the setting thread
+enum SharedStateStatus : uint32_t
+{
+	Ready = 1 << 0,
+	ContinuationClaimed = 1 << 1,
+	ContinuationAttached = 1 << 2,
+	Waiting = 1 << 3
+};
+
 template <typename T>
 class BaseSharedState
 {
@@ -22,49 +37,95 @@ public:
 	using ErrorType = std::exception_ptr;
 	using ExpectedType = stdx::expected<T, ErrorType>;
 	using UnexpectedType = stdx::unexpected<ErrorType>;
+	using Continuation = stdx::unique_function<void( ExpectedType& )>;
 
 	BaseSharedState() = default;
 
-	explicit BaseSharedState( const ExpectedType& result ) : m_result( result ) {}
-	explicit BaseSharedState( ExpectedType&& result ) : m_result( std::move( result ) ) {}
+	explicit BaseSharedState( const ExpectedType& result ) : m_result( result ) { MarkReady(); }
+	explicit BaseSharedState( ExpectedType&& result ) : m_result( std::move( result ) ) { MarkReady(); }
 
-	explicit BaseSharedState( const UnexpectedType& result ) : m_result( result ) {}
-	explicit BaseSharedState( UnexpectedType&& result ) : m_result( std::move( result ) ) {}
+	explicit BaseSharedState( const UnexpectedType& result ) : m_result( result ) { MarkReady(); }
+	explicit BaseSharedState( UnexpectedType&& result ) : m_result( std::move( result ) ) { MarkReady(); }
 
 	template <typename... Args>
-	explicit BaseSharedState( Args&&... args ) : m_result( std::in_place, std::forward<Args>( args )... ) {}
+	explicit BaseSharedState( Args&&... args ) : m_result( std::in_place, std::forward<Args>( args )... ) { MarkReady(); }
 
 	BaseSharedState( const BaseSharedState& ) = delete;
 	BaseSharedState( BaseSharedState&& ) = delete;
 	BaseSharedState& operator=( const BaseSharedState& ) = delete;
 	BaseSharedState& operator=( BaseSharedState&& ) = delete;
 
+	~BaseSharedState()
+	{
+		auto* node = m_extraContinuations.load( std::memory_order_acquire );
+		if ( node != ClosedList() )
+		{
+			while ( node )
+				delete std::exchange( node, node->next );
+		}
+	}
+
 	bool IsReady() const noexcept
 	{
-		std::lock_guard lock( m_mutex );
-		return UnsafeIsReady();
+		return m_status.load( std::memory_order_acquire ) & Ready;
 	}
 
+	// on a pool worker the wait runs queued tasks instead of blocking the thread
 	void Wait() const noexcept
 	{
-		std::unique_lock lock( m_mutex );
-		m_condition.wait( lock, [this] { return UnsafeIsReady(); } );
+		if ( !IsReady() )
+			WaitImpl( nullptr );
 	}
 
+	// returns false if the state is still not ready at the deadline
+	bool WaitUntil( WaitClock::time_point deadline ) const noexcept
+	{
+		return IsReady() || WaitImpl( &deadline );
+	}
+
+	// attaching the first continuation is wait free and does not allocate.
+	// Further continuations ( from shared futures ) go on a lock free list
 	template <typename Function>
 	void SetContinuation( Function&& func )
 	{
-		std::unique_lock lock( this->m_mutex );
-
-		if ( UnsafeIsReady() )
+		if ( IsReady() )
 		{
-			lock.unlock();
 			std::invoke( std::forward<Function>( func ), *m_result );
+			return;
 		}
-		else
+
+		uint32_t status = m_status.fetch_or( ContinuationClaimed, std::memory_order_acq_rel );
+		if ( !( status & ContinuationClaimed ) )
+		{
+			if ( status & Ready )
+			{
+				std::invoke( std::forward<Function>( func ), *m_result );
+				return;
+			}
+
+			m_continuation = std::forward<Function>( func );
+
+			// whoever sets their bit second runs the continuation
+			status = m_status.fetch_or( ContinuationAttached, std::memory_order_acq_rel );
+			if ( status & Ready )
+				std::exchange( m_continuation, nullptr )( *m_result );
+
+			return;
+		}
+
+		auto* node = new ContinuationNode{ std::forward<Function>( func ), nullptr };
+		auto* head = m_extraContinuations.load( std::memory_order_acquire );
+		do
 		{
-			m_continuations.emplace_back( std::forward<Function>( func ) );
+			if ( head == ClosedList() )
+			{
+				std::exchange( node->function, nullptr )( *m_result );
+				delete node;
+				return;
+			}
+			node->next = head;
 		}
+		while ( !m_extraContinuations.compare_exchange_weak( head, node, std::memory_order_acq_rel, std::memory_order_acquire ) );
 	}
 
 	decltype( auto ) Get() const &
@@ -85,8 +146,46 @@ public:
 			return std::move( m_result ).value().value();
 	}
 
+	void AddReference() const noexcept
+	{
+		m_referenceCount.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	// returns true if this was the last reference
+	bool RemoveReference() const noexcept
+	{
+		return m_referenceCount.fetch_sub( 1, std::memory_order_acq_rel ) == 1;
+	}
+
 private:
-	virtual bool UnsafeIsReady() const noexcept = 0;
+	struct ContinuationNode
+	{
+		Continuation function;
+		ContinuationNode* next;
+	};
+
+	static ContinuationNode* ClosedList() noexcept
+	{
+		return reinterpret_cast<ContinuationNode*>( uintptr_t( 1 ) );
+	}
+
+	void MarkReady() noexcept
+	{
+		m_status.store( Ready, std::memory_order_relaxed );
+		m_extraContinuations.store( ClosedList(), std::memory_order_relaxed );
+	}
+
+	bool WaitImpl( const WaitClock::time_point* deadline ) const noexcept
+	{
+		return HelpingWait( m_status,
+			[ this ] { return IsReady(); },
+			[ this ]
+			{
+				// let the setter know it has to wake somebody up
+				return m_status.fetch_or( Waiting, std::memory_order_acq_rel ) | Waiting;
+			},
+			deadline );
+	}
 
 	void WaitAndThrowOnError() const
 	{
@@ -96,20 +195,43 @@ private:
 			std::rethrow_exception( std::move( *this->m_result ).error() );
 	}
 
-	void UnsafeNotifyContinuations()
+protected:
+	// must only be called once m_result has been written
+	void Publish()
 	{
-		for ( auto& func : m_continuations )
+		const uint32_t status = m_status.fetch_or( Ready, std::memory_order_acq_rel );
+		dbAssert( !( status & Ready ) );
+
+		if ( status & Waiting )
+			AtomicNotifyAll( m_status );
+
+		if ( status & ContinuationAttached )
+			std::exchange( m_continuation, nullptr )( *m_result );
+
+		// run extra continuations in the order they were attached
+		auto* node = m_extraContinuations.exchange( ClosedList(), std::memory_order_acq_rel );
+		ContinuationNode* reversed = nullptr;
+		while ( node )
+		{
+			auto* next = node->next;
+			node->next = reversed;
+			reversed = node;
+			node = next;
+		}
+
+		for ( node = reversed; node; )
 		{
-			func( *m_result );
+			node->function( *m_result );
+			delete std::exchange( node, node->next );
 		}
-		m_continuations.clear();
 	}
 
 protected:
-	mutable std::mutex m_mutex;
-	mutable std::condition_variable m_condition;
+	mutable std::atomic<uint32_t> m_status = 0;
+	mutable std::atomic<uint32_t> m_referenceCount = 1;
 	std::optional<ExpectedType> m_result;
-	stdx::small_vector<std::function<void( ExpectedType& )>, 1> m_continuations;
+	Continuation m_continuation;
+	std::atomic<ContinuationNode*> m_extraContinuations = nullptr;
 };
 
 template <typename T>
@@ -126,34 +248,23 @@ public:
 	template <typename... Args>
 	void SetExpected( Args&&... args )
 	{
-		{
-			std::lock_guard lock( this->m_mutex );
-
-			dbAssert( !UnsafeIsReady() );
-
-			this->m_result.emplace( std::forward<Args>( args )... );
-
-			this->UnsafeNotifyContinuations();
-		}
-
-		this->m_condition.notify_all();
+		dbAssert( !this->IsReady() );
+		this->m_result.emplace( std::forward<Args>( args )... );
+		this->Publish();
 	}
 
 	template <typename... Args>
 	void SetValue( Args&&... args )
 	{
-		SetExpected( std::in_place, std::forward<Args>( args )... );
+		if constexpr ( std::is_void_v<T> )
+			SetExpected();
+		else
+			SetExpected( std::in_place, std::forward<Args>( args )... );
 	}
 
 	void SetError( ErrorType error )
 	{
-		SetValue( stdx::unexpect, std::move( error ) );
-	}
-
-private:
-	bool UnsafeIsReady() const noexcept final
-	{
-		return this->m_result.has_value();
+		SetExpected( stdx::unexpect, std::move( error ) );
 	}
 };
 
@@ -194,4 +305,80 @@ private:
 };
 */
 
-} // namespace Threading::Detail
\ No newline at end of file
+// intrusive reference counted pointer to a shared state. One pointer wide, no separate control block
+template <typename T>
+class SharedStatePtr
+{
+public:
+	using StateType = SharedState<T>;
+
+	SharedStatePtr() noexcept = default;
+	SharedStatePtr( std::nullptr_t ) noexcept {}
+
+	// adopts the initial reference of a newly created state
+	explicit SharedStatePtr( StateType* state ) noexcept : m_state( state ) {}
+
+	SharedStatePtr( const SharedStatePtr& other ) noexcept : m_state( other.m_state )
+	{
+		if ( m_state )
+			m_state->AddReference();
+	}
+
+	SharedStatePtr( SharedStatePtr&& other ) noexcept : m_state( std::exchange( other.m_state, nullptr ) ) {}
+
+	~SharedStatePtr()
+	{
+		Reset();
+	}
+
+	SharedStatePtr& operator=( const SharedStatePtr& other ) noexcept
+	{
+		SharedStatePtr( other ).Swap( *this );
+		return *this;
+	}
+
+	SharedStatePtr& operator=( SharedStatePtr&& other ) noexcept
+	{
+		SharedStatePtr( std::move( other ) ).Swap( *this );
+		return *this;
+	}
+
+	SharedStatePtr& operator=( std::nullptr_t ) noexcept
+	{
+		Reset();
+		return *this;
+	}
+
+	void Reset() noexcept
+	{
+		if ( m_state && m_state->RemoveReference() )
+			delete m_state;
+
+		m_state = nullptr;
+	}
+
+	void Swap( SharedStatePtr& other ) noexcept
+	{
+		std::swap( m_state, other.m_state );
+	}
+
+	StateType* Get() const noexcept { return m_state; }
+	StateType* operator->() const noexcept { return m_state; }
+	StateType& operator*() const noexcept { return *m_state; }
+
+	explicit operator bool() const noexcept { return m_state != nullptr; }
+
+	friend bool operator==( const SharedStatePtr& lhs, std::nullptr_t ) noexcept { return lhs.m_state == nullptr; }
+	friend bool operator!=( const SharedStatePtr& lhs, std::nullptr_t ) noexcept { return lhs.m_state != nullptr; }
+
+private:
+	StateType* m_state = nullptr;
+};
+
+template <typename T, typename... Args>
+SharedStatePtr<T> MakeSharedState( Args&&... args )
+{
+	return SharedStatePtr<T>( new SharedState<T>( std::forward<Args>( args )... ) );
+}
+
+} // namespace Threading::Detail
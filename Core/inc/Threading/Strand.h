@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Execution.h"
+#include "MpscQueue.h"
+
+#include <stdx/assert.h>
+#include <stdx/unique_function.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace Threading
+{
+
+namespace Detail
+{
+
+inline thread_local const void* t_currentStrand = nullptr;
+
+template <typename Exec>
+class StrandState : public std::enable_shared_from_this<StrandState<Exec>>
+{
+public:
+	using Task = stdx::unique_function<void()>;
+
+	// tasks run per turn on the underlying executor before the strand gives the thread back
+	static constexpr size_t MaxTasksPerTurn = 64;
+
+	explicit StrandState( const Exec& exec ) : m_executor( exec ) {}
+
+	template <typename Function>
+	void Post( Function&& f )
+	{
+		m_queue.Push( std::forward<Function>( f ) );
+
+		// whoever takes the count off zero schedules the drain. Only one drain runs at a time
+		if ( m_count.fetch_add( 1, std::memory_order_acq_rel ) == 0 )
+			Schedule();
+	}
+
+	bool IsRunningInThisThread() const noexcept
+	{
+		return t_currentStrand == this;
+	}
+
+	const Exec& GetInnerExecutor() const noexcept
+	{
+		return m_executor;
+	}
+
+private:
+	void Schedule()
+	{
+		Threading::Execute( m_executor, [ self = this->shared_from_this() ] { self->Drain(); } );
+	}
+
+	void Drain()
+	{
+		const void* previousStrand = std::exchange( t_currentStrand, this );
+
+		for ( size_t i = 0; ; ++i )
+		{
+			if ( i == MaxTasksPerTurn )
+			{
+				// the count is still non zero, so no producer can schedule a second drain
+				t_currentStrand = previousStrand;
+				Schedule();
+				return;
+			}
+
+			Task task;
+			while ( !m_queue.TryPop( task ) )
+			{
+				// the count says a task exists, its producer has not linked it yet
+				std::this_thread::yield();
+			}
+
+			task();
+
+			if ( m_count.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+				break;
+		}
+
+		t_currentStrand = previousStrand;
+	}
+
+private:
+	Exec m_executor;
+	MpscQueue<Task> m_queue;
+	std::atomic<size_t> m_count = 0;
+};
+
+} // namespace Detail
+
+// runs tasks one at a time, in submission order, on the underlying executor. Copies share the same queue,
+// so state only touched from tasks of one strand needs no lock
+template <typename Exec>
+class Strand
+{
+public:
+	explicit Strand( const Exec& exec = Exec() ) : m_state( std::make_shared<Detail::StrandState<Exec>>( exec ) ) {}
+
+	template <typename Function>
+	void Execute( Function&& f ) const
+	{
+		m_state->Post( std::forward<Function>( f ) );
+	}
+
+	constexpr size_t GetConcurrency() const noexcept
+	{
+		return 1;
+	}
+
+	// true inside a task of this strand
+	bool IsRunningInThisThread() const noexcept
+	{
+		return m_state->IsRunningInThisThread();
+	}
+
+	const Exec& GetInnerExecutor() const noexcept
+	{
+		return m_state->GetInnerExecutor();
+	}
+
+	bool operator==( const Strand& other ) const noexcept { return m_state == other.m_state; }
+	bool operator!=( const Strand& other ) const noexcept { return m_state != other.m_state; }
+
+private:
+	std::shared_ptr<Detail::StrandState<Exec>> m_state;
+};
+
+template <typename Exec>
+Strand( const Exec& )->Strand<Exec>;
+
+} // namespace Threading
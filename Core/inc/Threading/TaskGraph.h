@@ -0,0 +1,279 @@
+#pragma once
+
+#include "AtomicWait.h"
+#include "Execution.h"
+
+#include <stdx/assert.h>
+#include <stdx/unique_function.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Threading
+{
+
+// static DAG of tasks. Nodes and edges are declared once, then the graph can be run any number of times.
+// A run only resets counters, it does not allocate
+class TaskGraph
+{
+public:
+	using NodeId = uint32_t;
+	using Work = stdx::unique_function<void()>;
+
+	static constexpr NodeId InvalidNode = std::numeric_limits<NodeId>::max();
+
+	struct CriticalPath
+	{
+		std::vector<NodeId> nodes;
+		uint64_t nanoseconds = 0;
+	};
+
+	TaskGraph() = default;
+
+	TaskGraph( const TaskGraph& ) = delete;
+	TaskGraph& operator=( const TaskGraph& ) = delete;
+
+	~TaskGraph()
+	{
+		dbAssert( !IsRunning() );
+	}
+
+	NodeId AddNode( Work work, std::string_view name = {} );
+
+	// the subgraph runs on the same executor as this graph and completes the node when its last node finishes.
+	// It must outlive this graph and must not be run on its own while this graph is running
+	NodeId AddSubgraph( TaskGraph& subgraph, std::string_view name = {} );
+
+	// "to" starts after "from" finishes
+	void AddEdge( NodeId from, NodeId to );
+
+	size_t GetNodeCount() const noexcept
+	{
+		return m_nodes.size();
+	}
+
+	std::string_view GetNodeName( NodeId node ) const
+	{
+		return m_nodes[ node ].name;
+	}
+
+	// returns false if the edges contain a cycle
+	bool Validate() const;
+
+	// schedules every root on exec and returns
+	template <typename Exec>
+	void Start( const Exec& exec )
+	{
+		Launch( exec, false );
+	}
+
+	// blocks until the current run finishes, then rethrows the first exception thrown by a node
+	void Wait();
+
+	// runs one root on the calling thread, then waits for the rest
+	template <typename Exec>
+	void Run( const Exec& exec )
+	{
+		Launch( exec, true );
+		Wait();
+	}
+
+	bool IsRunning() const noexcept
+	{
+		return m_running.load( std::memory_order_acquire ) != 0;
+	}
+
+	// longest chain of node run times in the last run
+	CriticalPath GetCriticalPath() const;
+
+	void LogCriticalPath( std::ostream& out ) const;
+
+	// wall time of the last run
+	uint64_t GetLastRunNanoseconds() const noexcept
+	{
+		return m_endTime - m_startTime;
+	}
+
+private:
+	struct Node
+	{
+		Node( Work w, TaskGraph* sub, std::string_view n ) : work( std::move( w ) ), subgraph( sub ), name( n ) {}
+
+		Work work;
+		TaskGraph* subgraph = nullptr;
+		std::string name;
+
+		std::vector<NodeId> successors;
+		uint32_t predecessorCount = 0;
+		std::atomic<uint32_t> pending = 0;
+
+		uint64_t startTime = 0;
+		uint64_t endTime = 0;
+	};
+
+	static uint64_t Now() noexcept
+	{
+		return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+	}
+
+	void Reset();
+
+	template <typename Exec>
+	void Launch( const Exec& exec, bool runFirstRootInline );
+
+	// runs node and then, inline, one of the successors it made ready
+	template <typename Exec>
+	void RunNode( NodeId node, const Exec& exec );
+
+	// returns a successor that should run on the calling thread, or InvalidNode
+	template <typename Exec>
+	NodeId FinishNode( NodeId node, const Exec& exec );
+
+	template <typename Exec>
+	void Schedule( NodeId node, const Exec& exec )
+	{
+		Threading::Execute( exec, [ this, node, exec ] { RunNode( node, exec ); } );
+	}
+
+	template <typename Exec>
+	void Complete( const Exec& exec );
+
+	void SetError( std::exception_ptr error ) noexcept
+	{
+		if ( !m_failed.exchange( true, std::memory_order_acq_rel ) )
+			m_error = std::move( error );
+	}
+
+private:
+	std::deque<Node> m_nodes;
+	std::vector<NodeId> m_roots;
+	bool m_rootsDirty = false;
+
+	std::atomic<uint32_t> m_running = 0;
+	std::atomic<size_t> m_remaining = 0;
+	std::atomic<bool> m_failed = false;
+	std::exception_ptr m_error;
+
+	uint64_t m_startTime = 0;
+	uint64_t m_endTime = 0;
+
+	// set while this graph is a node of another graph
+	TaskGraph* m_parent = nullptr;
+	NodeId m_parentNode = InvalidNode;
+};
+
+template <typename Exec>
+void TaskGraph::Launch( const Exec& exec, bool runFirstRootInline )
+{
+	dbAssert( !IsRunning() );
+	dbAssert( Validate() );
+
+	Reset();
+
+	if ( m_nodes.empty() )
+	{
+		Complete( exec );
+		return;
+	}
+
+	const size_t firstScheduled = runFirstRootInline ? 1 : 0;
+	for ( size_t i = firstScheduled; i < m_roots.size(); ++i )
+		Schedule( m_roots[ i ], exec );
+
+	if ( runFirstRootInline )
+		RunNode( m_roots.front(), exec );
+}
+
+template <typename Exec>
+void TaskGraph::RunNode( NodeId nodeId, const Exec& exec )
+{
+	while ( nodeId != InvalidNode )
+	{
+		auto& node = m_nodes[ nodeId ];
+		node.startTime = Now();
+
+		if ( node.subgraph )
+		{
+			// the subgraph's last node finishes this node
+			node.subgraph->Launch( exec, true );
+			return;
+		}
+
+		try
+		{
+			node.work();
+		}
+		catch ( ... )
+		{
+			SetError( std::current_exception() );
+		}
+
+		nodeId = FinishNode( nodeId, exec );
+	}
+}
+
+template <typename Exec>
+TaskGraph::NodeId TaskGraph::FinishNode( NodeId nodeId, const Exec& exec )
+{
+	auto& node = m_nodes[ nodeId ];
+	node.endTime = Now();
+
+	NodeId next = InvalidNode;
+	for ( NodeId successor : node.successors )
+	{
+		if ( m_nodes[ successor ].pending.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+		{
+			if ( next != InvalidNode )
+				Schedule( next, exec );
+
+			next = successor;
+		}
+	}
+
+	// ready successors are still counted, so the graph cannot complete before they run
+	if ( m_remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+	{
+		dbAssert( next == InvalidNode );
+		Complete( exec );
+	}
+
+	return next;
+}
+
+template <typename Exec>
+void TaskGraph::Complete( const Exec& exec )
+{
+	m_endTime = Now();
+
+	if ( TaskGraph* parent = m_parent )
+	{
+		const NodeId parentNode = m_parentNode;
+		if ( m_failed.load( std::memory_order_acquire ) )
+			parent->SetError( m_error );
+
+		m_running.store( 0, std::memory_order_release );
+
+		// running the successor inline would nest a frame per subgraph in a chain of them
+		const NodeId next = parent->FinishNode( parentNode, exec );
+		if ( next != InvalidNode )
+			parent->Schedule( next, exec );
+
+		return;
+	}
+
+	// a waiter may destroy the graph as soon as it sees the store, so only the address is used after it.
+	// Wait() parks in the buckets, which are notified by address without reading the atomic
+	const void* running = &m_running;
+	m_running.store( 0, std::memory_order_release );
+	Detail::NotifyParkingBucket( running );
+}
+
+} // namespace Threading
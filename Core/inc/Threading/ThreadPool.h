@@ -1,17 +1,33 @@
 #pragma once
 
+#include "Affinity.h"
+#include "BandedQueue.h"
+#include "Cancellation.h"
+#include "Fiber.h"
+#include "ThreadPoolMetrics.h"
+
 #include <stdx/assert.h>
+#include <stdx/unique_function.h>
 #include <stdx/vector_s.h>
 
+#include <array>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
-#include <vector>
-#include <thread>
+#include <limits>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <thread>
+#include <vector>
 
 namespace Threading
 {
 
+template <typename T>
+class Future;
+
 enum class Priority : int
 {
 	Lowest = std::numeric_limits<int>::min(),
@@ -23,6 +39,63 @@ enum class Priority : int
 	Highest = std::numeric_limits<int>::max()
 };
 
+// priority values ordered from highest to lowest. Band 0 is the highest priority band
+inline constexpr std::array<Priority, 7> PriorityBands =
+{
+	Priority::Highest,
+	Priority::High,
+	Priority::MediumHigh,
+	Priority::Medium,
+	Priority::MediumLow,
+	Priority::Low,
+	Priority::Lowest
+};
+
+inline constexpr size_t PriorityBandCount = PriorityBands.size();
+
+// maps an arbitrary int priority to the band of the nearest Priority value
+constexpr size_t GetPriorityBand( int priority ) noexcept
+{
+	for ( size_t i = 0; i + 1 < PriorityBandCount; ++i )
+	{
+		const int64_t upper = static_cast<int64_t>( PriorityBands[ i ] );
+		const int64_t lower = static_cast<int64_t>( PriorityBands[ i + 1 ] );
+		if ( static_cast<int64_t>( priority ) > ( upper + lower ) / 2 )
+			return i;
+	}
+	return PriorityBandCount - 1;
+}
+
+enum class SchedulingMode
+{
+	// all workers pop from a single locked queue. Strict priority order by band, FIFO within a band
+	SharedQueue,
+
+	// tasks queued from a worker go to that worker's own deque and are popped LIFO.
+	// Idle workers steal FIFO from a random victim. Priority is respected per band within each queue, and a worker
+	// takes a shared task ahead of its own deque when the shared one ranks higher
+	WorkStealing
+};
+
+// a pool that sizes itself between minThreads and maxThreads
+struct ElasticOptions
+{
+	size_t minThreads = 1;
+
+	// also the number of worker slots. Can not be raised later
+	size_t maxThreads = std::thread::hardware_concurrency();
+
+	// a worker is added while tasks are queued, no worker is idle and queued tasks wait this long to start
+	std::chrono::microseconds growAfter{ 500 };
+
+	// a worker idle for this long exits unless the pool is at minThreads
+	std::chrono::milliseconds retireAfter{ 5000 };
+
+	// longest an idle worker spins before it sleeps. Each worker adapts its own spin within this bound,
+	// spinning longer while work keeps arriving during the spin. Zero never spins
+	std::chrono::microseconds maxSpin{ 50 };
+};
+
 class ThreadPool
 {
 private:
@@ -35,7 +108,7 @@ private:
 
 public:
 
-	using Task = std::function<void()>;
+	using Task = stdx::unique_function<void()>;
 
 	class Executor
 	{
@@ -46,6 +119,17 @@ public:
 			m_threadPool->QueueTask( std::forward<Function>( f ) );
 		}
 
+		template <typename Function>
+		void ExecuteCancellable( Function&& f, const CancellationToken& token ) const
+		{
+			m_threadPool->QueueTask( std::forward<Function>( f ), static_cast<int>( Priority::Medium ), token );
+		}
+
+		size_t GetConcurrency() const noexcept
+		{
+			return m_threadPool->GetThreadCount();
+		}
+
 	private:
 		Executor( ThreadPool* pool ) : m_threadPool( pool )
 		{
@@ -57,42 +141,22 @@ public:
 		friend class ThreadPool;
 	};
 
-	explicit ThreadPool( size_t threadCount = std::thread::hardware_concurrency() )
-	{
-		threadCount = std::max<size_t>( threadCount, 1 );
+	// with fibers, every task runs on a pooled fiber and a task that blocks on a future suspends instead of holding
+	// its worker. The fiber is resumed on whichever worker is free once the future is ready, so tasks must not rely on
+	// thread locals or hold locks across a wait. Timed waits still block the worker.
+	// Falls back to running tasks on the worker stack where fibers are not supported
+	explicit ThreadPool( size_t threadCount = std::thread::hardware_concurrency(), SchedulingMode mode = SchedulingMode::SharedQueue,
+		std::optional<FiberOptions> fibers = std::nullopt );
 
-		m_threads.reserve( threadCount );
-		for ( size_t i = 0; i < threadCount; ++i )
-		{
-			m_threads.emplace_back( [this, i]
-				{
-					for(;;)
-					{
-						Task task;
-
-						{
-							std::unique_lock lock( m_mutex );
-							m_condition.wait( lock, [this] { return m_signal != Signal::Run || !m_taskQueue.empty(); } );
-
-							if ( ( m_signal == Signal::Stop && m_taskQueue.empty() ) || m_signal == Signal::Kill )
-							{
-								return;
-							}
-
-							task = Pop();
-						}
-
-						task();
-					}
-				} );
-		}
-	}
+	// starts minThreads workers and grows or shrinks with the load
+	explicit ThreadPool( const ElasticOptions& elastic, SchedulingMode mode = SchedulingMode::SharedQueue,
+		std::optional<FiberOptions> fibers = std::nullopt );
 
-	~ThreadPool()
-	{
-		dbLog( "killing threads" );
-		JoinWithSignal( Signal::Kill );
-	}
+	// tasks still queued are destroyed without running. Their futures are not failed
+	~ThreadPool();
+
+	ThreadPool( const ThreadPool& ) = delete;
+	ThreadPool& operator=( const ThreadPool& ) = delete;
 
 	void QueueTask( Task task, Priority priority = Priority::Medium )
 	{
@@ -101,56 +165,121 @@ public:
 
 	void QueueTask( Task task, int priority )
 	{
-		{
-			std::lock_guard lock( m_mutex );
-			m_taskQueue.emplace( std::move( task ), priority );
-		}
+		QueueTask( std::move( task ), priority, CancellationToken() );
+	}
+
+	// the task is dropped without running if the token is cancelled before a worker starts it
+	void QueueTask( Task task, int priority, CancellationToken token );
 
-		m_condition.notify_one();
+	// queues a batch under a single lock and wakes at most one worker per task. The tasks are moved from
+	void QueueTasks( Task* tasks, size_t count, Priority priority = Priority::Medium )
+	{
+		QueueTasks( tasks, count, static_cast<int>( priority ) );
 	}
 
+	void QueueTasks( Task* tasks, size_t count, int priority );
+
+	// any range of callables
+	template <typename Range>
+	void QueueTasks( Range&& functions, Priority priority = Priority::Medium )
+	{
+		stdx::small_vector<Task, 64> tasks;
+		for ( auto&& f : functions )
+			tasks.emplace_back( std::forward<decltype( f )>( f ) );
+
+		QueueTasks( tasks.data(), tasks.size(), priority );
+	}
+
+	// queues the batch and returns one future for all of it. It becomes ready once every function has run
+	// and holds the first exception thrown. Defined in Future.h
+	template <typename Range>
+	Future<void> QueueTasksWithFuture( Range&& functions, Priority priority = Priority::Medium );
+
+	// removes queued tasks whose token has been cancelled. Returns the number removed
+	size_t RemoveCancelledTasks();
+
 	Executor GetExecutor()
 	{
 		return Executor( this );
 	}
 
-	void Join()
+	// workers currently running. Fixed unless the pool is elastic
+	size_t GetThreadCount() const noexcept
 	{
-		dbLog( "waiting to finish tasks" );
-		JoinWithSignal( Signal::Stop );
+		return m_activeThreads.load( std::memory_order_relaxed );
 	}
 
-private:
-	void JoinWithSignal( Signal s )
+	// the most workers the pool can have
+	size_t GetMaxThreadCount() const noexcept
 	{
-		dbAssert( s != Signal::Run );
+		return m_threadCount;
+	}
 
-		{
-			std::lock_guard lock( m_mutex );
-			m_signal = s;
-		}
+	bool IsElastic() const noexcept
+	{
+		return m_isElastic;
+	}
 
-		m_condition.notify_all();
+	// only for elastic pools. maxThreads is clamped to the slot count the pool was created with.
+	// Starts workers right away to reach minThreads, surplus workers retire once idle
+	void SetElasticOptions( const ElasticOptions& options );
 
-		for ( auto& t : m_threads )
-		{
-			t.join();
-		}
+	ElasticOptions GetElasticOptions() const;
+
+	SchedulingMode GetSchedulingMode() const noexcept
+	{
+		return m_mode;
 	}
 
-	Task Pop()
+	bool UsesFibers() const noexcept
 	{
-		dbAssert( !m_taskQueue.empty() );
-		Task task = std::move( const_cast<Entry&>( m_taskQueue.top() ).task );
-		m_taskQueue.pop();
-		return task;
+		return m_fiberOptions.has_value();
 	}
 
-private:
+	// a queued task is promoted one priority band for every interval it waits, so low priority work cannot starve.
+	// Off ( zero ) by default. Only applies to tasks queued after the call
+	void SetPriorityAging( std::chrono::nanoseconds interval );
+
+	// pins the workers to cpus. With pinEachWorker, worker i gets cpus[ i % size ] to itself,
+	// otherwise every worker may run on any of the cpus. Returns false if any worker could not be pinned
+	bool SetAffinity( const CpuSet& cpus, bool pinEachWorker = false );
+
+	// returns true if the calling thread is one of this pool's workers
+	bool IsWorkerThread() const noexcept;
+
+	// runs one queued task on the calling thread. Only works from this pool's workers, where blocking waits use it
+	// to keep the worker busy. Returns false if nothing ran
+	bool TryRunPendingTask();
+
+	void Join();
+
+#ifndef SHIPPING
+	// metrics are off by default. Turning them on resets all counters
+	void EnableMetrics( bool enable ) noexcept
+	{
+		m_metrics.Enable( enable );
+	}
+
+	bool MetricsEnabled() const noexcept
+	{
+		return m_metrics.IsEnabled();
+	}
 
+	ThreadPoolMetricsSnapshot GetMetrics() const
+	{
+		return m_metrics.Snapshot();
+	}
+
+	// writes a snapshot to threadpool.log, next to profile.log
+	void DumpMetrics( const char* filename = "threadpool.log" ) const;
+#endif
+
+private:
 	struct Entry
 	{
-		Entry( Task t, int p ) : task( std::move( t ) ), priority( p ) {}
+		Entry() = default;
+		Entry( Task t, int p, CancellationToken c ) : task( std::move( t ) ), priority( p ), token( std::move( c ) ) {}
+		Entry( Detail::Fiber* f, int p ) : priority( p ), fiber( f ) {}
 
 		Entry( Entry&& ) = default;
 		Entry& operator=( Entry&& ) = default;
@@ -159,21 +288,123 @@ private:
 		Entry& operator=( const Entry& ) = delete;
 
 		Task task;
-		int priority;
+		int priority = 0;
+		CancellationToken token;
+
+		// a suspended fiber to resume instead of a task
+		Detail::Fiber* fiber = nullptr;
+
+		// WaitClock ticks, only set by elastic pools
+		int64_t queuedAt = 0;
+
+#ifndef SHIPPING
+		uint64_t enqueueTime = 0;
+#endif
 
-		constexpr bool operator<( const Entry& other ) const noexcept
-		{
-			return priority < other.priority;
-		}
 	};
 
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		BandedQueue<Entry, PriorityBandCount> tasks;
+		uint32_t randomState = 0;
+	};
+
+private:
+	ThreadPool( size_t slotCount, std::optional<ElasticOptions> elastic, SchedulingMode mode, std::optional<FiberOptions> fibers );
+
+	// starts a worker in a free slot. Needs m_mutex held
+	void SpawnWorkerLocked();
+
+	void SetElasticOptionsLocked( const ElasticOptions& options );
+
+	void RunWorker( size_t workerIndex );
+	void RunSharedQueueWorker( size_t workerIndex );
+	void RunWorkStealingWorker( size_t workerIndex );
+
+	bool TryPopLocal( size_t workerIndex, Entry& entry );
+	bool TryPopShared( Entry& entry, bool newest = false );
+	bool TrySteal( size_t workerIndex, Entry& entry );
+
+	void RunTask( Entry& entry, size_t workerIndex );
+
+	// runs the task on a fiber when fibers are enabled
+	void InvokeTask( Entry& entry, size_t workerIndex );
+
+	void ResumeFiber( Detail::Fiber* fiber, size_t workerIndex );
+	void QueueFiber( Detail::Fiber* fiber );
+
+	static void WakeFiber( void* fiber );
+
+	void WakeWorker()
+	{
+		WakeWorkers( 1 );
+	}
+
+	void WakeWorkers( size_t count );
+
+	void JoinWithSignal( Signal s );
+
+	// spins for a while watching for queued tasks. Returns true if one showed up
+	bool SpinForWork( size_t workerIndex );
+
+	// sleeps on m_condition until ready(). Returns false if an elastic worker should retire instead
+	template <typename Ready>
+	bool WaitForWork( std::unique_lock<std::mutex>& lock, Ready&& ready );
+
+	void RunMonitor();
+	void WakeMonitor();
+
+	Entry Pop()
+	{
+		return m_taskQueue.Pop();
+	}
+
+private:
+	// one per worker slot. Threads of retired elastic workers are joined when their slot is reused
 	stdx::small_vector<std::thread, 16> m_threads;
-	std::priority_queue<Entry> m_taskQueue;
+	BandedQueue<Entry, PriorityBandCount> m_taskQueue;
 
-	std::mutex m_mutex;
+	mutable std::mutex m_mutex;
 	std::condition_variable m_condition;
 
 	Signal m_signal = Signal::Run;
+	const SchedulingMode m_mode;
+	size_t m_threadCount = 0;
+
+	// work stealing state
+	std::unique_ptr<WorkerQueue[]> m_workerQueues;
+	std::atomic<size_t> m_pendingTasks = 0;
+	std::atomic<size_t> m_sharedTasks = 0;
+	std::atomic<size_t> m_sleepingWorkers = 0;
+
+	// elastic state. Options are guarded by m_mutex, the monitor thread adds workers when the queue stalls
+	std::optional<ElasticOptions> m_elastic;
+	bool m_isElastic = false;
+	std::unique_ptr<bool[]> m_slotActive;
+	std::unique_ptr<int64_t[]> m_spinNanoseconds;
+	std::atomic<size_t> m_activeThreads = 0;
+	std::atomic<size_t> m_spinningWorkers = 0;
+	std::atomic<int64_t> m_maxSpinNanoseconds = 0;
+	std::atomic<int64_t> m_lastTaskStart = 0;
+	std::atomic<int64_t> m_longestQueueWait = 0;
+	std::atomic<bool> m_monitorSleeping = false;
+	std::condition_variable m_monitorCondition;
+	std::thread m_monitor;
+
+	// applied to workers started later
+	CpuSet m_affinity;
+	bool m_pinEachWorker = false;
+
+	// fiber state. Each worker keeps its own list of finished fibers, so reuse needs no lock.
+	// Active fibers have a task that has not finished. Suspended ones are not owned by any queue until they are woken
+	std::optional<FiberOptions> m_fiberOptions;
+	std::unique_ptr<std::vector<Detail::Fiber*>[]> m_freeFibers;
+	std::atomic<size_t> m_activeFibers = 0;
+
+#ifndef SHIPPING
+	Detail::ThreadPoolMetrics m_metrics;
+#endif
 };
 
 extern ThreadPool StaticThreadPool;
@@ -190,8 +421,19 @@ struct ConcurrentExecutor
 		StaticThreadPool.QueueTask( std::forward<Function>( f ) );
 	}
 
+	template <typename Function>
+	void ExecuteCancellable( Function&& f, const CancellationToken& token ) const
+	{
+		StaticThreadPool.QueueTask( std::forward<Function>( f ), static_cast<int>( Priority::Medium ), token );
+	}
+
+	size_t GetConcurrency() const noexcept
+	{
+		return StaticThreadPool.GetThreadCount();
+	}
+
 	constexpr bool operator==( const ConcurrentExecutor& ) const noexcept { return true; }
 	constexpr bool operator!=( const ConcurrentExecutor& ) const noexcept { return false; }
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#ifndef SHIPPING
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace Threading
+{
+
+// power of two buckets of nanoseconds. Bucket i counts durations in [ 2^i, 2^(i+1) )
+struct HistogramSnapshot
+{
+	static constexpr size_t BucketCount = 40;
+
+	std::array<uint64_t, BucketCount> buckets{};
+	uint64_t count = 0;
+	uint64_t totalNanoseconds = 0;
+	uint64_t maxNanoseconds = 0;
+
+	double GetMeanNanoseconds() const noexcept
+	{
+		return count ? static_cast<double>( totalNanoseconds ) / count : 0.0;
+	}
+
+	// upper bound of the bucket containing the given percentile ( 0 - 100 )
+	uint64_t GetPercentileNanoseconds( double percentile ) const noexcept;
+};
+
+struct WorkerMetricsSnapshot
+{
+	uint64_t tasksRun = 0;
+	uint64_t steals = 0;
+	uint64_t busyNanoseconds = 0;
+
+	// fraction of the sampled interval spent running tasks
+	double utilization = 0.0;
+};
+
+struct ThreadPoolMetricsSnapshot
+{
+	static constexpr size_t BandCount = 7;
+
+	std::array<uint64_t, BandCount> queueDepth{};
+	std::array<HistogramSnapshot, BandCount> queueLatency;
+	std::array<HistogramSnapshot, BandCount> runTime;
+	std::vector<WorkerMetricsSnapshot> workers;
+	uint64_t elapsedNanoseconds = 0;
+
+	void Log( std::ostream& out ) const;
+};
+
+namespace Detail
+{
+
+class LatencyHistogram
+{
+public:
+	void Record( uint64_t nanoseconds ) noexcept
+	{
+		m_buckets[ GetBucket( nanoseconds ) ].fetch_add( 1, std::memory_order_relaxed );
+		m_count.fetch_add( 1, std::memory_order_relaxed );
+		m_total.fetch_add( nanoseconds, std::memory_order_relaxed );
+
+		uint64_t max = m_max.load( std::memory_order_relaxed );
+		while ( nanoseconds > max && !m_max.compare_exchange_weak( max, nanoseconds, std::memory_order_relaxed ) ) {}
+	}
+
+	HistogramSnapshot Snapshot() const noexcept;
+
+	void Reset() noexcept;
+
+private:
+	static size_t GetBucket( uint64_t nanoseconds ) noexcept
+	{
+		size_t bucket = 0;
+		for ( unsigned shift : { 32u, 16u, 8u, 4u, 2u, 1u } )
+		{
+			if ( nanoseconds >> shift )
+			{
+				nanoseconds >>= shift;
+				bucket += shift;
+			}
+		}
+		return std::min( bucket, HistogramSnapshot::BucketCount - 1 );
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, HistogramSnapshot::BucketCount> m_buckets{};
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<uint64_t> m_total = 0;
+	std::atomic<uint64_t> m_max = 0;
+};
+
+// counters written by the pool. Everything is relaxed, a snapshot is only approximately consistent
+class ThreadPoolMetrics
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static uint64_t Now() noexcept
+	{
+		return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now().time_since_epoch() ).count() );
+	}
+
+	explicit ThreadPoolMetrics( size_t workerCount );
+
+	bool IsEnabled() const noexcept
+	{
+		return m_enabled.load( std::memory_order_relaxed );
+	}
+
+	void Enable( bool enable ) noexcept;
+
+	void Reset() noexcept;
+
+	void OnQueued( size_t band ) noexcept
+	{
+		m_queueDepth[ band ].fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	// enqueueTime is 0 if metrics were off when the task was queued. Such tasks were never counted
+	void OnStarted( size_t band, uint64_t enqueueTime, uint64_t startTime ) noexcept
+	{
+		if ( enqueueTime != 0 )
+		{
+			m_queueDepth[ band ].fetch_sub( 1, std::memory_order_relaxed );
+			m_queueLatency[ band ].Record( startTime - enqueueTime );
+		}
+	}
+
+	// a cancelled task removed before it ran
+	void OnDropped( size_t band, uint64_t enqueueTime ) noexcept
+	{
+		if ( enqueueTime != 0 )
+			m_queueDepth[ band ].fetch_sub( 1, std::memory_order_relaxed );
+	}
+
+	void OnFinished( size_t band, size_t workerIndex, uint64_t startTime, uint64_t endTime ) noexcept
+	{
+		const uint64_t elapsed = endTime - startTime;
+		m_runTime[ band ].Record( elapsed );
+
+		auto& worker = m_workers[ workerIndex ];
+		worker.tasksRun.fetch_add( 1, std::memory_order_relaxed );
+		worker.busyNanoseconds.fetch_add( elapsed, std::memory_order_relaxed );
+	}
+
+	void OnSteal( size_t workerIndex ) noexcept
+	{
+		m_workers[ workerIndex ].steals.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	ThreadPoolMetricsSnapshot Snapshot() const;
+
+private:
+	// padded so workers do not share cache lines
+	struct alignas( 64 ) WorkerCounters
+	{
+		std::atomic<uint64_t> tasksRun = 0;
+		std::atomic<uint64_t> steals = 0;
+		std::atomic<uint64_t> busyNanoseconds = 0;
+	};
+
+	std::atomic<bool> m_enabled = false;
+	std::atomic<uint64_t> m_startTime = 0;
+
+	// only counts tasks queued while enabled, so it can read low right after metrics are turned on
+	std::array<std::atomic<int64_t>, ThreadPoolMetricsSnapshot::BandCount> m_queueDepth{};
+	std::array<LatencyHistogram, ThreadPoolMetricsSnapshot::BandCount> m_queueLatency;
+	std::array<LatencyHistogram, ThreadPoolMetricsSnapshot::BandCount> m_runTime;
+
+	std::unique_ptr<WorkerCounters[]> m_workers;
+	size_t m_workerCount;
+};
+
+} // namespace Detail
+
+} // namespace Threading
+
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Affinity.h"
+#include "ThreadPool.h"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Threading
+{
+
+enum class StandardPool
+{
+	// cpu bound work. This is StaticThreadPool, so ConcurrentExecutor shares it
+	Compute,
+
+	// blocking file and network access
+	IO,
+
+	// low priority housekeeping
+	Background
+};
+
+std::string_view GetStandardPoolName( StandardPool pool ) noexcept;
+
+struct ThreadPoolConfig
+{
+	std::string name;
+	size_t threadCount = std::thread::hardware_concurrency();
+	SchedulingMode mode = SchedulingMode::SharedQueue;
+
+	// workers are pinned to these cpus. Empty leaves scheduling to the OS
+	CpuSet cpus;
+
+	// adds the cpus of this NUMA node to cpus
+	std::optional<uint32_t> numaNode;
+
+	// give each worker a single cpu from the set instead of letting them share it
+	bool pinEachWorker = false;
+
+	// run tasks on fibers so blocking on a future does not hold a worker
+	std::optional<FiberOptions> fibers;
+
+	// grow and shrink between the elastic limits instead of keeping threadCount workers
+	std::optional<ElasticOptions> elastic;
+};
+
+// process wide set of named thread pools. A pool is created the first time it is requested,
+// from its configuration if one was given or from defaults otherwise
+class ThreadPoolRegistry
+{
+public:
+	static ThreadPoolRegistry* Get()
+	{
+		static ThreadPoolRegistry s_instance;
+		return &s_instance;
+	}
+
+	// must happen before the pool is first requested. Returns false if the pool already exists.
+	// The compute pool already exists, so only its affinity can be configured
+	bool Configure( ThreadPoolConfig config );
+
+	ThreadPool& GetPool( std::string_view name );
+
+	ThreadPool& GetPool( StandardPool pool )
+	{
+		return GetPool( GetStandardPoolName( pool ) );
+	}
+
+	// null if the pool has not been created
+	ThreadPool* FindPool( std::string_view name );
+
+private:
+	struct NamedPool
+	{
+		std::string name;
+		ThreadPool* pool = nullptr;
+		std::unique_ptr<ThreadPool> ownedPool;
+	};
+
+	ThreadPoolRegistry();
+	ThreadPoolRegistry( const ThreadPoolRegistry& ) = delete;
+
+	static ThreadPoolConfig GetDefaultConfig( std::string_view name );
+
+	static void ApplyAffinity( ThreadPool& pool, const ThreadPoolConfig& config );
+
+	NamedPool* FindNamedPool( std::string_view name );
+
+private:
+	std::vector<NamedPool> m_pools;
+	std::vector<ThreadPoolConfig> m_configs;
+	std::mutex m_mutex;
+};
+
+// executor for one of the standard pools. The pool is looked up once
+template <StandardPool Pool>
+struct StandardPoolExecutor
+{
+	template <typename Function>
+	void Execute( Function&& f ) const
+	{
+		GetPool().QueueTask( std::forward<Function>( f ) );
+	}
+
+	template <typename Function>
+	void ExecuteCancellable( Function&& f, const CancellationToken& token ) const
+	{
+		GetPool().QueueTask( std::forward<Function>( f ), static_cast<int>( Priority::Medium ), token );
+	}
+
+	size_t GetConcurrency() const noexcept
+	{
+		return GetPool().GetThreadCount();
+	}
+
+	constexpr bool operator==( const StandardPoolExecutor& ) const noexcept { return true; }
+	constexpr bool operator!=( const StandardPoolExecutor& ) const noexcept { return false; }
+
+private:
+	static ThreadPool& GetPool()
+	{
+		static ThreadPool& s_pool = ThreadPoolRegistry::Get()->GetPool( Pool );
+		return s_pool;
+	}
+};
+
+using ComputeExecutor = StandardPoolExecutor<StandardPool::Compute>;
+using IOExecutor = StandardPoolExecutor<StandardPool::IO>;
+using BackgroundExecutor = StandardPoolExecutor<StandardPool::Background>;
+
+} // namespace Threading
@@ -0,0 +1,310 @@
+#pragma once
+
+#include "Future.h"
+
+#include <stdx/unique_function.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Threading
+{
+
+class TimeoutError : public std::runtime_error
+{
+public:
+	TimeoutError() : std::runtime_error( "future timed out" ) {}
+};
+
+class TimerCancelledError : public std::runtime_error
+{
+public:
+	TimerCancelledError() : std::runtime_error( "timer cancelled" ) {}
+};
+
+struct TimerId
+{
+	uint32_t index = std::numeric_limits<uint32_t>::max();
+	uint32_t generation = 0;
+
+	bool Valid() const noexcept { return index != std::numeric_limits<uint32_t>::max(); }
+};
+
+// hierarchical timer wheel serviced by one thread. Four levels of 256 slots, so insert and cancel are O( 1 ).
+// Callbacks are handed to their executor from the timer thread and must not block it
+class TimerWheel
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using Duration = Clock::duration;
+	using TimePoint = Clock::time_point;
+
+	static TimerWheel* Get()
+	{
+		static TimerWheel s_instance;
+		return &s_instance;
+	}
+
+	explicit TimerWheel( Duration resolution = std::chrono::milliseconds( 1 ) );
+
+	// pending timers are cancelled
+	~TimerWheel();
+
+	TimerWheel( const TimerWheel& ) = delete;
+	TimerWheel& operator=( const TimerWheel& ) = delete;
+
+	// runs f on exec once the deadline has passed. Cancelling fails the future with TimerCancelledError
+	template <typename Exec, typename Function>
+	auto ScheduleAt( TimePoint deadline, const Exec& exec, Function&& f );
+
+	template <typename Exec, typename Function>
+	auto ScheduleAfter( Duration delay, const Exec& exec, Function&& f )
+	{
+		return ScheduleAt( Clock::now() + delay, exec, std::forward<Function>( f ) );
+	}
+
+	// future becomes ready after the delay
+	std::pair<Future<void>, TimerId> ScheduleAfter( Duration delay );
+
+	// runs f on exec every period until cancelled. The future becomes ready when the timer is cancelled
+	// and holds the error if f throws, which also stops the timer
+	template <typename Exec, typename Function>
+	std::pair<Future<void>, TimerId> ScheduleEvery( Duration period, const Exec& exec, Function&& f );
+
+	// returns false if the timer already fired or was cancelled
+	bool Cancel( TimerId timer );
+
+	size_t GetPendingCount() const;
+
+private:
+	static constexpr uint32_t LevelBits = 8;
+	static constexpr uint32_t SlotCount = 1 << LevelBits;
+	static constexpr uint32_t SlotMask = SlotCount - 1;
+	static constexpr uint32_t LevelCount = 4;
+
+	using Callback = stdx::unique_function<void()>;
+
+	struct Node;
+
+	struct List
+	{
+		Node* head = nullptr;
+	};
+
+	struct Node
+	{
+		Node* prev = nullptr;
+		Node* next = nullptr;
+		List* list = nullptr;
+
+		uint64_t deadline = 0;
+		uint64_t period = 0;
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		Callback onFire;
+		std::shared_ptr<Callback> onPeriodicFire;
+		Callback onCancel;
+	};
+
+	TimerId Insert( uint64_t deadline, uint64_t period, Callback onFire, std::shared_ptr<Callback> onPeriodicFire, Callback onCancel )
+	{
+		std::lock_guard lock( m_mutex );
+		return InsertLocked( deadline, period, std::move( onFire ), std::move( onPeriodicFire ), std::move( onCancel ) );
+	}
+
+	TimerId InsertLocked( uint64_t deadline, uint64_t period, Callback onFire, std::shared_ptr<Callback> onPeriodicFire, Callback onCancel );
+
+	uint64_t ToTick( TimePoint time ) const noexcept;
+	uint64_t ToTicks( Duration duration ) const noexcept;
+
+	void Link( Node& node );
+	void Unlink( Node& node );
+	void Release( Node& node );
+
+	// first occupied level 0 slot at or after the given slot, or SlotCount
+	uint32_t FindOccupiedSlot( uint32_t first ) const noexcept;
+
+	void Cascade( uint32_t level );
+	void ProcessTick( uint64_t tick );
+	void Advance( uint64_t targetTick );
+	uint64_t GetNextEventTick() const noexcept;
+
+	void Run();
+
+private:
+	const Duration m_resolution;
+	const TimePoint m_epoch;
+
+	std::array<std::array<List, SlotCount>, LevelCount> m_wheel;
+	std::array<uint64_t, SlotCount / 64> m_occupiedSlots{};
+	List m_overflow;
+
+	std::deque<Node> m_nodes;
+	std::vector<uint32_t> m_freeNodes;
+	std::vector<Callback> m_fired;
+	size_t m_pendingCount = 0;
+
+	// every timer due at or before the current tick has fired
+	uint64_t m_currentTick = 0;
+
+	// tick the timer thread is sleeping until. 0 while it is awake
+	uint64_t m_wakeTick = 0;
+	bool m_stop = false;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+};
+
+template <typename Exec, typename Function>
+auto TimerWheel::ScheduleAt( TimePoint deadline, const Exec& exec, Function&& f )
+{
+	using R = std::decay_t<std::invoke_result_t<std::decay_t<Function>&&>>;
+
+	auto[ future, promise ] = MakeFuturePromisePair<R>();
+
+	// promise and function are shared by the fire and cancel paths. Exactly one of them runs
+	struct Shared
+	{
+		Shared( Promise<R> p, std::decay_t<Function> fn, const Exec& e ) : promise( std::move( p ) ), function( std::move( fn ) ), executor( e ) {}
+
+		Promise<R> promise;
+		std::decay_t<Function> function;
+		Exec executor;
+	};
+
+	auto shared = std::make_shared<Shared>( std::move( promise ), std::forward<Function>( f ), exec );
+
+	Callback onFire = [ shared ]
+	{
+		Threading::Execute( shared->executor, Detail::Task( std::move( shared->promise ), std::move( shared->function ) ) );
+	};
+
+	Callback onCancel = [ shared ]
+	{
+		shared->promise.SetError( std::make_exception_ptr( TimerCancelledError() ) );
+	};
+
+	const TimerId timer = Insert( ToTick( deadline ), 0, std::move( onFire ), nullptr, std::move( onCancel ) );
+	return std::make_pair( std::move( future ), timer );
+}
+
+inline std::pair<Future<void>, TimerId> TimerWheel::ScheduleAfter( Duration delay )
+{
+	return ScheduleAt( Clock::now() + delay, InlineExecutor(), [] {} );
+}
+
+template <typename Exec, typename Function>
+std::pair<Future<void>, TimerId> TimerWheel::ScheduleEvery( Duration period, const Exec& exec, Function&& f )
+{
+	dbAssert( period > Duration::zero() );
+
+	auto[ future, promise ] = MakeFuturePromisePair<void>();
+
+	struct Shared
+	{
+		Shared( Promise<void> p, std::decay_t<Function> fn, const Exec& e ) : promise( std::move( p ) ), function( std::move( fn ) ), executor( e ) {}
+
+		std::atomic<bool> done = false;
+		Promise<void> promise;
+		std::decay_t<Function> function;
+		Exec executor;
+		TimerId timer;
+		TimerWheel* wheel = nullptr;
+	};
+
+	auto shared = std::make_shared<Shared>( std::move( promise ), std::forward<Function>( f ), exec );
+	shared->wheel = this;
+
+	auto onPeriodicFire = std::make_shared<Callback>( [ shared ]
+	{
+		Threading::Execute( shared->executor, [ shared ]
+			{
+				if ( shared->done.load( std::memory_order_acquire ) )
+					return;
+
+				try
+				{
+					shared->function();
+				}
+				catch ( ... )
+				{
+					if ( !shared->done.exchange( true, std::memory_order_acq_rel ) )
+					{
+						shared->wheel->Cancel( shared->timer );
+						shared->promise.SetError( std::current_exception() );
+					}
+				}
+			} );
+	} );
+
+	Callback onCancel = [ shared ]
+	{
+		if ( !shared->done.exchange( true, std::memory_order_acq_rel ) )
+			shared->promise.SetValue();
+	};
+
+	const uint64_t ticks = std::max<uint64_t>( ToTicks( period ), 1 );
+
+	const uint64_t firstTick = ToTick( Clock::now() ) + ticks;
+
+	// the id is written before the timer thread can fire it
+	std::unique_lock lock( m_mutex );
+	const TimerId timer = InsertLocked( firstTick, ticks, nullptr, std::move( onPeriodicFire ), std::move( onCancel ) );
+	shared->timer = timer;
+	lock.unlock();
+
+	return std::make_pair( std::move( future ), timer );
+}
+
+// fails with TimeoutError if this future is not ready in time
+template <typename T>
+Future<T> Future<T>::WithTimeout( std::chrono::nanoseconds timeout ) &&
+{
+	struct Shared
+	{
+		explicit Shared( Promise<T> p ) : promise( std::move( p ) ) {}
+
+		std::atomic<bool> done = false;
+		Promise<T> promise;
+		TimerId timer;
+	};
+
+	auto[ future, promise ] = MakeFuturePromisePair<T>();
+	auto shared = std::make_shared<Shared>( std::move( promise ) );
+
+	auto* wheel = TimerWheel::Get();
+	auto[ timerFuture, timer ] = wheel->ScheduleAfter( std::chrono::duration_cast<TimerWheel::Duration>( timeout ), InlineExecutor(), [ shared ]
+		{
+			if ( !shared->done.exchange( true, std::memory_order_acq_rel ) )
+				shared->promise.SetError( std::make_exception_ptr( TimeoutError() ) );
+		} );
+
+	// the timer's own future would block on destruction
+	timerFuture.Discard();
+	shared->timer = timer;
+
+	auto state = std::exchange( this->m_state, nullptr );
+	state->SetContinuation( [ shared, wheel ]( Expected<T>& expected )
+		{
+			if ( !shared->done.exchange( true, std::memory_order_acq_rel ) )
+			{
+				wheel->Cancel( shared->timer );
+				shared->promise.SetExpected( std::move( expected ) );
+			}
+		} );
+
+	return std::move( future );
+}
+
+} // namespace Threading
@@ -0,0 +1,509 @@
+#pragma once
+
+#include <Threading/Future.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// parallel versions of the classic algorithms on top of Threading executors.
+// Ranges must be random access. Callables may be invoked concurrently from several threads.
+// The blocking versions run chunks on the calling thread too, so they are safe to call from inside a pool task.
+// The _async versions return a Threading::Future and require the ranges to outlive it
+
+namespace stdx::par
+{
+
+// chunks smaller than this are not worth a task. Use with_grain() for elements that are expensive on their own
+inline constexpr std::size_t default_grain_size = 1024;
+
+// upper bound on chunks per worker. More chunks balance uneven work at the cost of scheduling overhead
+inline constexpr std::size_t chunks_per_worker = 4;
+
+// runs on another executor but splits ranges into chunks of at least grain elements instead of default_grain_size
+template <typename Executor>
+struct grained_executor
+{
+	Executor executor;
+	std::size_t grain = default_grain_size;
+
+	template <typename Function>
+	void Execute( Function&& f ) const
+	{
+		Threading::Execute( executor, std::forward<Function>( f ) );
+	}
+
+	std::size_t GetConcurrency() const noexcept
+	{
+		return Threading::GetConcurrency( executor );
+	}
+
+	bool operator==( const grained_executor& other ) const noexcept { return executor == other.executor && grain == other.grain; }
+	bool operator!=( const grained_executor& other ) const noexcept { return !( *this == other ); }
+};
+
+// e.g. stdx::par::for_each( stdx::par::with_grain( exec, 1 ), entities.begin(), entities.end(), update )
+// lets even a few hundred expensive entities spread over every worker
+template <typename Executor>
+grained_executor<Executor> with_grain( Executor exec, std::size_t grain )
+{
+	return grained_executor<Executor>{ std::move( exec ), std::max<std::size_t>( grain, 1 ) };
+}
+
+namespace detail
+{
+
+template <typename Executor>
+std::size_t grain_size( const Executor& ) noexcept
+{
+	return default_grain_size;
+}
+
+template <typename Executor>
+std::size_t grain_size( const grained_executor<Executor>& exec ) noexcept
+{
+	return exec.grain;
+}
+
+template <typename Executor>
+std::size_t chunk_count( const Executor& exec, std::size_t size ) noexcept
+{
+	const std::size_t grain = grain_size( exec );
+	const std::size_t workers = Threading::GetConcurrency( exec );
+	if ( workers <= 1 || size <= grain )
+		return size > 0 ? 1 : 0;
+
+	return std::clamp<std::size_t>( size / grain, 1, workers * chunks_per_worker );
+}
+
+// [begin, end) offsets of chunk i when size elements are split into count chunks
+inline std::pair<std::size_t, std::size_t> chunk_range( std::size_t i, std::size_t count, std::size_t size ) noexcept
+{
+	const std::size_t base = size / count;
+	const std::size_t extra = size % count;
+	const std::size_t begin = i * base + std::min( i, extra );
+	return { begin, begin + base + ( i < extra ? 1 : 0 ) };
+}
+
+// runs chunk( i ) for every i in [0, count), then completes the future with finish()
+template <typename R, typename ChunkFn, typename FinishFn>
+class parallel_job
+{
+public:
+	parallel_job( std::size_t count, ChunkFn chunk, FinishFn finish, Threading::Promise<R> promise )
+		: m_count( count )
+		, m_remaining( count )
+		, m_chunk( std::move( chunk ) )
+		, m_finish( std::move( finish ) )
+		, m_promise( std::move( promise ) )
+	{}
+
+	void run_chunks() noexcept
+	{
+		for ( ;; )
+		{
+			const std::size_t i = m_next.fetch_add( 1, std::memory_order_relaxed );
+			if ( i >= m_count )
+				return;
+
+			if ( !m_failed.load( std::memory_order_relaxed ) )
+			{
+				try
+				{
+					m_chunk( i );
+				}
+				catch ( ... )
+				{
+					if ( !m_failed.exchange( true ) )
+						m_error = std::current_exception();
+				}
+			}
+
+			if ( m_remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+				complete();
+		}
+	}
+
+private:
+	void complete() noexcept
+	{
+		if ( m_failed.load( std::memory_order_acquire ) )
+		{
+			m_promise.SetError( std::move( m_error ) );
+			return;
+		}
+
+		try
+		{
+			if constexpr ( std::is_void_v<R> )
+			{
+				m_finish();
+				m_promise.SetValue();
+			}
+			else
+			{
+				m_promise.SetValue( m_finish() );
+			}
+		}
+		catch ( ... )
+		{
+			m_promise.SetError( std::current_exception() );
+		}
+	}
+
+private:
+	const std::size_t m_count;
+	std::atomic<std::size_t> m_next = 0;
+	std::atomic<std::size_t> m_remaining;
+	std::atomic<bool> m_failed = false;
+	std::exception_ptr m_error;
+	ChunkFn m_chunk;
+	FinishFn m_finish;
+	Threading::Promise<R> m_promise;
+};
+
+// launches count chunks on the executor. If the caller will help it gets the job back to call run_chunks() itself
+template <typename R, typename Executor, typename ChunkFn, typename FinishFn>
+auto launch( const Executor& exec, std::size_t count, ChunkFn&& chunk, FinishFn&& finish, bool callerHelps )
+{
+	using Job = parallel_job<R, std::decay_t<ChunkFn>, std::decay_t<FinishFn>>;
+
+	auto[ future, promise ] = Threading::MakeFuturePromisePair<R>();
+
+	if ( count == 0 )
+	{
+		if constexpr ( std::is_void_v<R> )
+		{
+			finish();
+			promise.SetValue();
+		}
+		else
+		{
+			promise.SetValue( finish() );
+		}
+		return std::make_pair( std::shared_ptr<Job>(), std::move( future ) );
+	}
+
+	auto job = std::make_shared<Job>( count, std::forward<ChunkFn>( chunk ), std::forward<FinishFn>( finish ), std::move( promise ) );
+
+	const std::size_t workers = std::min( count, Threading::GetConcurrency( exec ) );
+	for ( std::size_t i = callerHelps ? 1 : 0; i < workers; ++i )
+		Threading::Execute( exec, [job] { job->run_chunks(); } );
+
+	return std::make_pair( callerHelps ? std::move( job ) : std::shared_ptr<Job>(), std::move( future ) );
+}
+
+template <typename R, typename Executor, typename ChunkFn, typename FinishFn>
+R run( const Executor& exec, std::size_t count, ChunkFn&& chunk, FinishFn&& finish )
+{
+	auto[ job, future ] = launch<R>( exec, count, std::forward<ChunkFn>( chunk ), std::forward<FinishFn>( finish ), true );
+	if ( job )
+		job->run_chunks();
+
+	return std::move( future ).Get();
+}
+
+template <typename R, typename Executor, typename ChunkFn, typename FinishFn>
+Threading::Future<R> run_async( const Executor& exec, std::size_t count, ChunkFn&& chunk, FinishFn&& finish )
+{
+	return std::move( launch<R>( exec, count, std::forward<ChunkFn>( chunk ), std::forward<FinishFn>( finish ), false ).second );
+}
+
+template <class RandomIt>
+std::size_t distance( RandomIt first, RandomIt last )
+{
+	static_assert( std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<RandomIt>::iterator_category>,
+		"parallel algorithms require random access iterators" );
+
+	return static_cast<std::size_t>( std::distance( first, last ) );
+}
+
+struct no_result
+{
+	void operator()() const noexcept {}
+};
+
+// sort chunks independently then merge neighbouring runs, doubling the run length each pass
+template <typename Executor, class RandomIt, class Compare, class SortFn>
+void merge_sort( const Executor& exec, RandomIt first, RandomIt last, Compare comp, SortFn sortChunk )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = chunk_count( exec, size );
+	if ( count <= 1 )
+	{
+		sortChunk( first, last, comp );
+		return;
+	}
+
+	std::vector<std::size_t> bounds( count + 1 );
+	for ( std::size_t i = 0; i < count; ++i )
+		bounds[ i ] = chunk_range( i, count, size ).first;
+	bounds[ count ] = size;
+
+	run<void>( exec, count, [&]( std::size_t i )
+		{
+			sortChunk( first + bounds[ i ], first + bounds[ i + 1 ], comp );
+		}, no_result{} );
+
+	for ( std::size_t width = 1; width < count; width *= 2 )
+	{
+		const std::size_t merges = ( count + 2 * width - 1 ) / ( 2 * width );
+		run<void>( exec, merges, [&]( std::size_t m )
+			{
+				const std::size_t lo = m * 2 * width;
+				const std::size_t mid = std::min( lo + width, count );
+				const std::size_t hi = std::min( lo + 2 * width, count );
+				if ( mid < hi )
+					std::inplace_merge( first + bounds[ lo ], first + bounds[ mid ], first + bounds[ hi ], comp );
+			}, no_result{} );
+	}
+}
+
+} // namespace detail
+
+// for_each
+
+template <typename Executor, class RandomIt, class UnaryFunction>
+void for_each( const Executor& exec, RandomIt first, RandomIt last, UnaryFunction f )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	detail::run<void>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			std::for_each( first + begin, first + end, std::ref( f ) );
+		}, detail::no_result{} );
+}
+
+template <typename Executor, class RandomIt, class UnaryFunction>
+Threading::Future<void> for_each_async( const Executor& exec, RandomIt first, RandomIt last, UnaryFunction f )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	return detail::run_async<void>( exec, count, [=]( std::size_t i ) mutable
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			std::for_each( first + begin, first + end, std::ref( f ) );
+		}, detail::no_result{} );
+}
+
+// transform
+
+template <typename Executor, class RandomIt, class OutputIt, class UnaryOperation>
+OutputIt transform( const Executor& exec, RandomIt first, RandomIt last, OutputIt dest, UnaryOperation op )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	detail::run<void>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			std::transform( first + begin, first + end, dest + begin, std::ref( op ) );
+		}, detail::no_result{} );
+
+	return dest + size;
+}
+
+template <typename Executor, class RandomIt1, class RandomIt2, class OutputIt, class BinaryOperation>
+OutputIt transform( const Executor& exec, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, OutputIt dest, BinaryOperation op )
+{
+	const std::size_t size = detail::distance( first1, last1 );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	detail::run<void>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			std::transform( first1 + begin, first1 + end, first2 + begin, dest + begin, std::ref( op ) );
+		}, detail::no_result{} );
+
+	return dest + size;
+}
+
+template <typename Executor, class RandomIt, class OutputIt, class UnaryOperation>
+Threading::Future<OutputIt> transform_async( const Executor& exec, RandomIt first, RandomIt last, OutputIt dest, UnaryOperation op )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	return detail::run_async<OutputIt>( exec, count, [=]( std::size_t i ) mutable
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			std::transform( first + begin, first + end, dest + begin, std::ref( op ) );
+		}, [=] { return dest + size; } );
+}
+
+// reduce
+
+template <typename Executor, class RandomIt, class T, class BinaryReduceOp, class UnaryTransformOp>
+T transform_reduce( const Executor& exec, RandomIt first, RandomIt last, T init, BinaryReduceOp reduce, UnaryTransformOp transform )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	std::vector<std::optional<T>> partials( count );
+
+	return detail::run<T>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			auto it = first + begin;
+			T sum = transform( *it );
+			for ( ++it; it != first + end; ++it )
+				sum = reduce( std::move( sum ), transform( *it ) );
+			partials[ i ].emplace( std::move( sum ) );
+		},
+		[&]
+		{
+			T result = std::move( init );
+			for ( auto& partial : partials )
+				result = reduce( std::move( result ), std::move( *partial ) );
+			return result;
+		} );
+}
+
+template <typename Executor, class RandomIt1, class RandomIt2, class T, class BinaryReduceOp, class BinaryTransformOp>
+T transform_reduce( const Executor& exec, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, T init, BinaryReduceOp reduce, BinaryTransformOp transform )
+{
+	const std::size_t size = detail::distance( first1, last1 );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	std::vector<std::optional<T>> partials( count );
+
+	return detail::run<T>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			T sum = transform( first1[ begin ], first2[ begin ] );
+			for ( std::size_t j = begin + 1; j < end; ++j )
+				sum = reduce( std::move( sum ), transform( first1[ j ], first2[ j ] ) );
+			partials[ i ].emplace( std::move( sum ) );
+		},
+		[&]
+		{
+			T result = std::move( init );
+			for ( auto& partial : partials )
+				result = reduce( std::move( result ), std::move( *partial ) );
+			return result;
+		} );
+}
+
+template <typename Executor, class RandomIt1, class RandomIt2, class T>
+T transform_reduce( const Executor& exec, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, T init )
+{
+	return stdx::par::transform_reduce( exec, first1, last1, first2, std::move( init ), std::plus<>(), std::multiplies<>() );
+}
+
+template <typename Executor, class RandomIt, class T, class BinaryOp = std::plus<>>
+T reduce( const Executor& exec, RandomIt first, RandomIt last, T init, BinaryOp op = {} )
+{
+	return stdx::par::transform_reduce( exec, first, last, std::move( init ), op, []( const auto& value ) -> T { return value; } );
+}
+
+template <typename Executor, class RandomIt, class T, class BinaryReduceOp, class UnaryTransformOp>
+Threading::Future<T> transform_reduce_async( const Executor& exec, RandomIt first, RandomIt last, T init, BinaryReduceOp reduce, UnaryTransformOp transform )
+{
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+
+	auto partials = std::make_shared<std::vector<std::optional<T>>>( count );
+
+	return detail::run_async<T>( exec, count, [=]( std::size_t i ) mutable
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			auto it = first + begin;
+			T sum = transform( *it );
+			for ( ++it; it != first + end; ++it )
+				sum = reduce( std::move( sum ), transform( *it ) );
+			( *partials )[ i ].emplace( std::move( sum ) );
+		},
+		[=]() mutable
+		{
+			T result = std::move( init );
+			for ( auto& partial : *partials )
+				result = reduce( std::move( result ), std::move( *partial ) );
+			return result;
+		} );
+}
+
+template <typename Executor, class RandomIt, class T, class BinaryOp = std::plus<>>
+Threading::Future<T> reduce_async( const Executor& exec, RandomIt first, RandomIt last, T init, BinaryOp op = {} )
+{
+	return stdx::par::transform_reduce_async( exec, first, last, std::move( init ), op, []( const auto& value ) -> T { return value; } );
+}
+
+// inclusive_scan. Accumulates each chunk, scans the chunk sums serially, then rescans each chunk with its offset
+
+template <typename Executor, class RandomIt, class OutputIt, class BinaryOp = std::plus<>>
+OutputIt inclusive_scan( const Executor& exec, RandomIt first, RandomIt last, OutputIt dest, BinaryOp op = {} )
+{
+	using T = typename std::iterator_traits<RandomIt>::value_type;
+
+	const std::size_t size = detail::distance( first, last );
+	const std::size_t count = detail::chunk_count( exec, size );
+	if ( count <= 1 )
+		return std::inclusive_scan( first, last, dest, op );
+
+	std::vector<std::optional<T>> offsets( count );
+
+	detail::run<void>( exec, count - 1, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			offsets[ i + 1 ].emplace( std::accumulate( first + begin + 1, first + end, T( first[ begin ] ), op ) );
+		}, detail::no_result{} );
+
+	for ( std::size_t i = 2; i < count; ++i )
+		offsets[ i ].emplace( op( *offsets[ i - 1 ], std::move( *offsets[ i ] ) ) );
+
+	detail::run<void>( exec, count, [&]( std::size_t i )
+		{
+			const auto[ begin, end ] = detail::chunk_range( i, count, size );
+			if ( i == 0 )
+				std::inclusive_scan( first + begin, first + end, dest + begin, op );
+			else
+				std::inclusive_scan( first + begin, first + end, dest + begin, op, *offsets[ i ] );
+		}, detail::no_result{} );
+
+	return dest + size;
+}
+
+template <typename Executor, class RandomIt, class OutputIt, class BinaryOp = std::plus<>>
+Threading::Future<OutputIt> inclusive_scan_async( const Executor& exec, RandomIt first, RandomIt last, OutputIt dest, BinaryOp op = {} )
+{
+	return Threading::TwoWayExecute( exec, [=] { return stdx::par::inclusive_scan( exec, first, last, dest, op ); } );
+}
+
+// sort
+
+template <typename Executor, class RandomIt, class Compare = std::less<>>
+void sort( const Executor& exec, RandomIt first, RandomIt last, Compare comp = {} )
+{
+	detail::merge_sort( exec, first, last, comp, []( RandomIt f, RandomIt l, Compare& c ) { std::sort( f, l, c ); } );
+}
+
+template <typename Executor, class RandomIt, class Compare = std::less<>>
+void stable_sort( const Executor& exec, RandomIt first, RandomIt last, Compare comp = {} )
+{
+	detail::merge_sort( exec, first, last, comp, []( RandomIt f, RandomIt l, Compare& c ) { std::stable_sort( f, l, c ); } );
+}
+
+template <typename Executor, class RandomIt, class Compare = std::less<>>
+Threading::Future<void> sort_async( const Executor& exec, RandomIt first, RandomIt last, Compare comp = {} )
+{
+	return Threading::TwoWayExecute( exec, [=] { stdx::par::sort( exec, first, last, comp ); } );
+}
+
+template <typename Executor, class RandomIt, class Compare = std::less<>>
+Threading::Future<void> stable_sort_async( const Executor& exec, RandomIt first, RandomIt last, Compare comp = {} )
+{
+	return Threading::TwoWayExecute( exec, [=] { stdx::par::stable_sort( exec, first, last, comp ); } );
+}
+
+} // namespace stdx::par
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <future>
 #include <vector>
 #include <thread>
@@ -57,7 +60,7 @@ public:
 	~thread_pool()
 	{
 		{
-			std::lock_guard{ m_queueLock };
+			std::lock_guard lock{ m_queueLock };
 			m_signal = signal::stop;
 		}
 
@@ -79,7 +82,7 @@ public:
 		auto result = task->get_future();
 
 		{
-			std::lock_guard{ m_queueLock };
+			std::lock_guard lock{ m_queueLock };
 			m_taskQueue.emplace( [ task = std::move( task ) ]{ ( *task )( ); } );
 		}
 
@@ -88,8 +91,67 @@ public:
 		return result;
 	}
 
+	// queues every callable under one lock and returns a single future for the batch.
+	// It becomes ready once all of them have run and holds the first exception thrown
+	template <typename Range>
+	[[nodiscard]] std::future<void> push_bulk( Range&& functions )
+	{
+		auto state = std::make_shared<bulk_state>();
+		auto result = state->promise.get_future();
+
+		size_t count = 0;
+		{
+			std::lock_guard lock{ m_queueLock };
+			for ( auto&& f : functions )
+			{
+				m_taskQueue.emplace( [ state, f = std::forward<decltype( f )>( f ) ]() mutable
+				{
+					try
+					{
+						f();
+					}
+					catch ( ... )
+					{
+						if ( !state->failed.exchange( true ) )
+							state->error = std::current_exception();
+					}
+
+					if ( --state->remaining == 0 )
+					{
+						if ( state->failed )
+							state->promise.set_exception( state->error );
+						else
+							state->promise.set_value();
+					}
+				} );
+				++count;
+			}
+
+			// workers cannot finish the batch before the count is known, since the lock is held
+			state->remaining = count;
+		}
+
+		if ( count == 0 )
+			state->promise.set_value();
+		else if ( count >= m_threads.size() )
+			m_condition.notify_all();
+		else
+			for ( size_t i = 0; i < count; ++i )
+				m_condition.notify_one();
+
+		return result;
+	}
+
 private:
 
+	struct bulk_state
+	{
+		std::atomic<size_t> remaining = 0;
+		std::atomic<bool> failed = false;
+		std::exception_ptr error;
+		std::promise<void> promise;
+	};
+
 	std::vector<std::thread> m_threads;
 	std::queue<std::function<void()>> m_taskQueue;
 
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace stdx
+{
+
+// default buffer makes sizeof( unique_function ) one cache line on 64 bit targets
+inline constexpr std::size_t unique_function_default_buffer_size = 6 * sizeof( void* );
+
+template <typename Signature, std::size_t BufferSize = unique_function_default_buffer_size>
+class unique_function;
+
+template <typename T>
+struct is_unique_function : std::false_type {};
+
+template <typename Signature, std::size_t BufferSize>
+struct is_unique_function<unique_function<Signature, BufferSize>> : std::true_type {};
+
+template <typename T>
+inline constexpr bool is_unique_function_v = is_unique_function<T>::value;
+
+// move only type erased function. Callables that fit in the buffer and are nothrow movable are stored inline,
+// everything else is heap allocated
+template <typename R, typename... Args, std::size_t BufferSize>
+class unique_function<R( Args... ), BufferSize>
+{
+	static_assert( BufferSize >= sizeof( void* ) );
+
+	using storage_type = std::aligned_storage_t<BufferSize, alignof( std::max_align_t )>;
+
+	template <typename F>
+	static constexpr bool stored_inline =
+		sizeof( F ) <= BufferSize &&
+		alignof( std::max_align_t ) % alignof( F ) == 0 &&
+		std::is_nothrow_move_constructible_v<F>;
+
+	struct metadata
+	{
+		using invoke_fn = R( * )( void*, Args&&... );
+		using move_fn = void( * )( void*, void* ) noexcept;
+		using destroy_fn = void( * )( void* ) noexcept;
+
+		template <typename F>
+		static F* get( void* storage ) noexcept
+		{
+			if constexpr ( stored_inline<F> )
+				return std::launder( static_cast<F*>( storage ) );
+			else
+				return *static_cast<F**>( storage );
+		}
+
+		template <typename F>
+		static R invoke_imp( void* storage, Args&&... args )
+		{
+			return std::invoke( *get<F>( storage ), std::forward<Args>( args )... );
+		}
+
+		template <typename F>
+		static void move_imp( void* dest, void* src ) noexcept
+		{
+			if constexpr ( stored_inline<F> )
+			{
+				F* srcObj = get<F>( src );
+				new( dest ) F( std::move( *srcObj ) );
+				std::destroy_at( srcObj );
+			}
+			else
+			{
+				*static_cast<F**>( dest ) = *static_cast<F**>( src );
+			}
+		}
+
+		template <typename F>
+		static void destroy_imp( void* storage ) noexcept
+		{
+			if constexpr ( stored_inline<F> )
+				std::destroy_at( get<F>( storage ) );
+			else
+				delete get<F>( storage );
+		}
+
+		invoke_fn invoke;
+		move_fn move;
+		destroy_fn destroy;
+	};
+
+	template <typename F>
+	static inline const metadata s_metadata
+	{
+		&metadata::template invoke_imp<F>,
+		&metadata::template move_imp<F>,
+		&metadata::template destroy_imp<F>
+	};
+
+public:
+	using result_type = R;
+
+	static constexpr std::size_t buffer_size = BufferSize;
+
+	unique_function() noexcept = default;
+
+	unique_function( std::nullptr_t ) noexcept {}
+
+	template <typename F,
+		std::enable_if_t<!is_unique_function_v<std::decay_t<F>> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>, int> = 0>
+	unique_function( F&& f )
+	{
+		using T = std::decay_t<F>;
+
+		if constexpr ( std::is_pointer_v<T> || std::is_member_pointer_v<T> )
+		{
+			if ( f == nullptr )
+				return;
+		}
+
+		if constexpr ( stored_inline<T> )
+			new( &m_storage ) T( std::forward<F>( f ) );
+		else
+			*reinterpret_cast<T**>( &m_storage ) = new T( std::forward<F>( f ) );
+
+		m_metadata = &s_metadata<T>;
+	}
+
+	unique_function( const unique_function& ) = delete;
+	unique_function& operator=( const unique_function& ) = delete;
+
+	unique_function( unique_function&& other ) noexcept
+	{
+		move_from( other );
+	}
+
+	unique_function& operator=( unique_function&& other ) noexcept
+	{
+		if ( this != &other )
+		{
+			reset();
+			move_from( other );
+		}
+		return *this;
+	}
+
+	unique_function& operator=( std::nullptr_t ) noexcept
+	{
+		reset();
+		return *this;
+	}
+
+	template <typename F,
+		std::enable_if_t<!is_unique_function_v<std::decay_t<F>> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>, int> = 0>
+	unique_function& operator=( F&& f )
+	{
+		return *this = unique_function( std::forward<F>( f ) );
+	}
+
+	~unique_function()
+	{
+		reset();
+	}
+
+	R operator()( Args... args )
+	{
+		return m_metadata->invoke( &m_storage, std::forward<Args>( args )... );
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return m_metadata != nullptr;
+	}
+
+	friend bool operator==( const unique_function& f, std::nullptr_t ) noexcept { return !f; }
+	friend bool operator!=( const unique_function& f, std::nullptr_t ) noexcept { return static_cast<bool>( f ); }
+
+	void swap( unique_function& other ) noexcept
+	{
+		std::swap( *this, other );
+	}
+
+private:
+	void move_from( unique_function& other ) noexcept
+	{
+		if ( other.m_metadata )
+		{
+			other.m_metadata->move( &m_storage, &other.m_storage );
+			m_metadata = std::exchange( other.m_metadata, nullptr );
+		}
+	}
+
+	void reset() noexcept
+	{
+		if ( m_metadata )
+			std::exchange( m_metadata, nullptr )->destroy( &m_storage );
+	}
+
+private:
+	storage_type m_storage;
+	const metadata* m_metadata = nullptr;
+};
+
+namespace detail
+{
+	template <typename>
+	struct unique_function_signature {};
+
+	template <typename R, typename C, typename... Args>
+	struct unique_function_signature<R( C::* )( Args... )> { using type = R( Args... ); };
+
+	template <typename R, typename C, typename... Args>
+	struct unique_function_signature<R( C::* )( Args... ) const> { using type = R( Args... ); };
+
+	template <typename R, typename C, typename... Args>
+	struct unique_function_signature<R( C::* )( Args... ) noexcept> { using type = R( Args... ); };
+
+	template <typename R, typename C, typename... Args>
+	struct unique_function_signature<R( C::* )( Args... ) const noexcept> { using type = R( Args... ); };
+}
+
+template <typename R, typename... Args>
+unique_function( R( * )( Args... ) )->unique_function<R( Args... )>;
+
+template <typename F>
+unique_function( F )->unique_function<typename detail::unique_function_signature<decltype( &F::operator() )>::type>;
+
+} // namespace stdx
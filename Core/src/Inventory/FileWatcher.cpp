@@ -0,0 +1,220 @@
+#include "Inventory/FileWatcher.h"
+
+#include <stdx/assert.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined( __linux__ ) && __has_include( <sys/inotify.h> )
+#define CORE_FILEWATCHER_INOTIFY
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#endif
+
+#if defined( CORE_FILEWATCHER_INOTIFY )
+
+// watches the directories instead of the files, since editors often save by replacing the file
+struct FileWatcher::State
+{
+	int inotify = -1;
+	int wake = -1;
+
+	std::mutex mutex;
+
+	// watch descriptor to directory and back
+	std::unordered_map<int, std::string> directories;
+	std::unordered_map<std::string, int> watches;
+
+	// directory/name to the filenames given to Watch()
+	std::unordered_map<std::string, std::vector<std::string>> files;
+};
+
+namespace
+{
+	std::pair<std::string, std::string> SplitPath( const std::string& filename )
+	{
+		const auto path = std::filesystem::path( filename ).lexically_normal();
+		auto directory = path.parent_path().string();
+		if ( directory.empty() )
+			directory = ".";
+
+		return { std::move( directory ), path.filename().string() };
+	}
+}
+
+FileWatcher::FileWatcher( Callback onChanged, std::chrono::milliseconds )
+	: m_onChanged( std::move( onChanged ) )
+	, m_state( std::make_unique<State>() )
+{
+	m_state->inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	m_state->wake = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	dbAssertMessage( m_state->inotify >= 0 && m_state->wake >= 0, "failed to start file watcher" );
+
+	m_thread = std::thread( &FileWatcher::Run, this );
+}
+
+FileWatcher::~FileWatcher()
+{
+	const uint64_t one = 1;
+	[[maybe_unused]] const auto written = write( m_state->wake, &one, sizeof( one ) );
+	m_thread.join();
+
+	close( m_state->inotify );
+	close( m_state->wake );
+}
+
+void FileWatcher::Watch( const std::string& filename )
+{
+	auto[ directory, name ] = SplitPath( filename );
+
+	std::lock_guard lock( m_state->mutex );
+
+	if ( m_state->watches.find( directory ) == m_state->watches.end() )
+	{
+		const int wd = inotify_add_watch( m_state->inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+		if ( wd < 0 )
+		{
+			dbLogWarning( "FileWatcher cannot watch [%s]", directory.c_str() );
+			return;
+		}
+
+		m_state->directories[ wd ] = directory;
+		m_state->watches[ directory ] = wd;
+	}
+
+	auto& watched = m_state->files[ directory + '/' + name ];
+	if ( std::find( watched.begin(), watched.end(), filename ) == watched.end() )
+		watched.push_back( filename );
+}
+
+void FileWatcher::Run()
+{
+	pollfd fds[ 2 ] = { { m_state->inotify, POLLIN, 0 }, { m_state->wake, POLLIN, 0 } };
+
+	alignas( inotify_event ) char buffer[ 4096 ];
+	std::vector<std::string> changed;
+
+	for (;;)
+	{
+		if ( poll( fds, 2, -1 ) < 0 )
+			continue;
+
+		if ( fds[ 1 ].revents & POLLIN )
+			return;
+
+		const auto length = read( m_state->inotify, buffer, sizeof( buffer ) );
+		if ( length <= 0 )
+			continue;
+
+		{
+			std::lock_guard lock( m_state->mutex );
+			for ( ssize_t offset = 0; offset < length; )
+			{
+				const auto* event = reinterpret_cast<const inotify_event*>( buffer + offset );
+				offset += sizeof( inotify_event ) + event->len;
+
+				if ( event->len == 0 )
+					continue;
+
+				auto directory = m_state->directories.find( event->wd );
+				if ( directory == m_state->directories.end() )
+					continue;
+
+				auto file = m_state->files.find( directory->second + '/' + event->name );
+				if ( file == m_state->files.end() )
+					continue;
+
+				// a save often arrives as several events
+				for ( auto& filename : file->second )
+				{
+					if ( std::find( changed.begin(), changed.end(), filename ) == changed.end() )
+						changed.push_back( filename );
+				}
+			}
+		}
+
+		for ( auto& filename : changed )
+			m_onChanged( filename );
+
+		changed.clear();
+	}
+}
+
+#else
+
+struct FileWatcher::State
+{
+	std::chrono::milliseconds pollInterval;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stop = false;
+
+	std::unordered_map<std::string, std::filesystem::file_time_type> files;
+};
+
+FileWatcher::FileWatcher( Callback onChanged, std::chrono::milliseconds pollInterval )
+	: m_onChanged( std::move( onChanged ) )
+	, m_state( std::make_unique<State>() )
+{
+	m_state->pollInterval = pollInterval;
+	m_thread = std::thread( &FileWatcher::Run, this );
+}
+
+FileWatcher::~FileWatcher()
+{
+	{
+		std::lock_guard lock( m_state->mutex );
+		m_state->stop = true;
+	}
+	m_state->condition.notify_one();
+	m_thread.join();
+}
+
+void FileWatcher::Watch( const std::string& filename )
+{
+	std::error_code error;
+	const auto time = std::filesystem::last_write_time( filename, error );
+
+	std::lock_guard lock( m_state->mutex );
+	m_state->files.insert( { filename, error ? std::filesystem::file_time_type() : time } );
+}
+
+void FileWatcher::Run()
+{
+	std::vector<std::string> changed;
+
+	std::unique_lock lock( m_state->mutex );
+	for (;;)
+	{
+		if ( m_state->condition.wait_for( lock, m_state->pollInterval, [ this ] { return m_state->stop; } ) )
+			return;
+
+		for ( auto&[ filename, lastWrite ] : m_state->files )
+		{
+			std::error_code error;
+			const auto time = std::filesystem::last_write_time( filename, error );
+			if ( !error && time != lastWrite )
+			{
+				lastWrite = time;
+				changed.push_back( filename );
+			}
+		}
+
+		lock.unlock();
+		for ( auto& filename : changed )
+			m_onChanged( filename );
+
+		changed.clear();
+		lock.lock();
+	}
+}
+
+#endif
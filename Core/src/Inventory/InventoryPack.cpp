@@ -0,0 +1,298 @@
+#include "Inventory/InventoryPack.h"
+
+#include "ByteIO.h"
+
+#include <stdx/assert.h>
+#include <stdx/utility.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr uint32_t PackTag = 'IPAK';
+	constexpr uint32_t PackVersion = 1;
+	constexpr uint64_t ItemAlignment = 16;
+
+	// file layout: header, index sorted by hash, item names, then the items in path order
+	struct PackHeader
+	{
+		uint32_t tag;
+		uint32_t version;
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+	struct PackEntry
+	{
+		InventoryItemHash hash;
+		uint32_t nameSize;
+		uint64_t nameOffset;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	static_assert( sizeof( PackHeader ) == 16 && sizeof( PackEntry ) == 32 );
+
+	uint64_t AlignUp( uint64_t offset ) noexcept
+	{
+		return ( offset + ItemAlignment - 1 ) & ~( ItemAlignment - 1 );
+	}
+
+	const PackEntry* GetEntries( const std::byte* data ) noexcept
+	{
+		return reinterpret_cast<const PackEntry*>( data + sizeof( PackHeader ) );
+	}
+
+	bool InRange( uint64_t offset, uint64_t size, uint64_t total ) noexcept
+	{
+		return offset <= total && size <= total - offset;
+	}
+
+#if defined( _WIN32 )
+
+	const std::byte* MapFile( const std::string& filename, size_t& size )
+	{
+		HANDLE file = ::CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file == INVALID_HANDLE_VALUE )
+			return nullptr;
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = nullptr;
+		if ( ::GetFileSizeEx( file, &fileSize ) && fileSize.QuadPart > 0 )
+			mapping = ::CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+		const void* view = mapping ? ::MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) : nullptr;
+
+		// the view keeps the mapping alive on its own
+		if ( mapping )
+			::CloseHandle( mapping );
+		::CloseHandle( file );
+
+		size = view ? static_cast<size_t>( fileSize.QuadPart ) : 0;
+		return static_cast<const std::byte*>( view );
+	}
+
+	void UnmapFile( const std::byte* data, size_t )
+	{
+		::UnmapViewOfFile( data );
+	}
+
+#else
+
+	const std::byte* MapFile( const std::string& filename, size_t& size )
+	{
+		const int file = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+		if ( file < 0 )
+			return nullptr;
+
+		struct stat status;
+		void* view = MAP_FAILED;
+		if ( ::fstat( file, &status ) == 0 && status.st_size > 0 )
+			view = ::mmap( nullptr, static_cast<size_t>( status.st_size ), PROT_READ, MAP_PRIVATE, file, 0 );
+
+		// the mapping keeps the file alive on its own
+		::close( file );
+
+		if ( view == MAP_FAILED )
+			return nullptr;
+
+		size = static_cast<size_t>( status.st_size );
+		return static_cast<const std::byte*>( view );
+	}
+
+	void UnmapFile( const std::byte* data, size_t size )
+	{
+		::munmap( const_cast<std::byte*>( data ), size );
+	}
+
+#endif
+}
+
+bool InventoryPack::Open( const std::string& filename )
+{
+	Close();
+
+	size_t size = 0;
+	const std::byte* data = MapFile( filename, size );
+	if ( data == nullptr )
+	{
+		dbLogWarning( "InventoryPack cannot map [%s]", filename.c_str() );
+		return false;
+	}
+
+	// validate everything once so lookups can trust the index
+	const auto* header = reinterpret_cast<const PackHeader*>( data );
+	bool valid = size >= sizeof( PackHeader ) && header->tag == PackTag && header->version == PackVersion &&
+		InRange( sizeof( PackHeader ), uint64_t( header->count ) * sizeof( PackEntry ), size );
+
+	const PackEntry* entries = valid ? GetEntries( data ) : nullptr;
+	for ( uint32_t i = 0; valid && i < header->count; ++i )
+	{
+		const auto& entry = entries[ i ];
+		valid = InRange( entry.nameOffset, entry.nameSize, size ) && InRange( entry.offset, entry.size, size ) &&
+			( i == 0 || entries[ i - 1 ].hash < entry.hash );
+	}
+
+	if ( !valid )
+	{
+		dbLogWarning( "InventoryPack [%s] is not a valid pack", filename.c_str() );
+		UnmapFile( data, size );
+		return false;
+	}
+
+	dbLog( "InventoryPack::Open( %s ) %u items", filename.c_str(), header->count );
+	m_data = data;
+	m_size = size;
+	m_count = header->count;
+	return true;
+}
+
+void InventoryPack::Close()
+{
+	if ( m_data == nullptr )
+		return;
+
+	UnmapFile( m_data, m_size );
+	m_data = nullptr;
+	m_size = 0;
+	m_count = 0;
+}
+
+std::optional<InventoryBytes> InventoryPack::Find( std::string_view filename ) const
+{
+	if ( m_data == nullptr )
+		return std::nullopt;
+
+	const auto hash = stdx::hash_fnv1a<InventoryItemHash>( filename );
+	const PackEntry* first = GetEntries( m_data );
+	const PackEntry* last = first + m_count;
+	const PackEntry* entry = std::lower_bound( first, last, hash, []( const PackEntry& lhs, InventoryItemHash rhs ) { return lhs.hash < rhs; } );
+	if ( entry == last || entry->hash != hash )
+		return std::nullopt;
+
+	const std::string_view name( reinterpret_cast<const char*>( m_data + entry->nameOffset ), entry->nameSize );
+	if ( name != filename )
+	{
+		dbLogWarning( "detected hash collision [%.*s] [%.*s]", int( filename.size() ), filename.data(), int( name.size() ), name.data() );
+		return std::nullopt;
+	}
+
+	return InventoryBytes{ m_data + entry->offset, static_cast<size_t>( entry->size ) };
+}
+
+bool BuildInventoryPack( const std::string& directory, const std::string& filename, std::string_view prefix )
+{
+	namespace fs = std::filesystem;
+
+	struct Item
+	{
+		fs::path path;
+		std::string name;
+		PackEntry entry;
+	};
+
+	std::vector<Item> items;
+	std::error_code error;
+	for ( fs::recursive_directory_iterator it( directory, error ), end; !error && it != end; it.increment( error ) )
+	{
+		// a pack written into the directory it packs must not pack its previous self
+		std::error_code ignored;
+		if ( !it->is_regular_file( error ) || fs::equivalent( it->path(), filename, ignored ) )
+			continue;
+
+		auto name = std::string( prefix ) + it->path().lexically_relative( directory ).generic_string();
+		const auto size = it->file_size( error );
+		items.push_back( Item{ it->path(), name, PackEntry{ stdx::hash_fnv1a<InventoryItemHash>( name ), static_cast<uint32_t>( name.size() ), 0, 0, size } } );
+	}
+
+	if ( error )
+	{
+		dbLogWarning( "BuildInventoryPack() cannot read [%s]: %s", directory.c_str(), error.message().c_str() );
+		return false;
+	}
+
+	// items are stored in path order, so files that sit together on disk stay together in the pack
+	std::sort( items.begin(), items.end(), []( const Item& lhs, const Item& rhs ) { return lhs.name < rhs.name; } );
+
+	uint64_t offset = sizeof( PackHeader ) + items.size() * sizeof( PackEntry );
+	for ( auto& item : items )
+	{
+		item.entry.nameOffset = offset;
+		offset += item.name.size();
+	}
+
+	for ( auto& item : items )
+	{
+		offset = AlignUp( offset );
+		item.entry.offset = offset;
+		offset += item.entry.size;
+	}
+
+	std::vector<PackEntry> index;
+	index.reserve( items.size() );
+	for ( auto& item : items )
+		index.push_back( item.entry );
+
+	std::sort( index.begin(), index.end(), []( const PackEntry& lhs, const PackEntry& rhs ) { return lhs.hash < rhs.hash; } );
+
+	auto collision = std::adjacent_find( index.begin(), index.end(), []( const PackEntry& lhs, const PackEntry& rhs ) { return lhs.hash == rhs.hash; } );
+	if ( collision != index.end() )
+	{
+		dbLogWarning( "BuildInventoryPack() detected hash collision [%08x]", collision->hash );
+		return false;
+	}
+
+	ByteWriter out( filename.c_str() );
+	if ( !out.IsOpen() )
+	{
+		dbLogWarning( "BuildInventoryPack() cannot write [%s]", filename.c_str() );
+		return false;
+	}
+
+	out.WriteHeader( PackTag, PackVersion );
+	out.WriteUint32( static_cast<uint32_t>( items.size() ) );
+	out.WriteUint32( 0 );
+	out.WriteBytes( index.data(), index.size() * sizeof( PackEntry ) );
+
+	offset = sizeof( PackHeader ) + items.size() * sizeof( PackEntry );
+	for ( auto& item : items )
+	{
+		out.WriteBytes( item.name.data(), item.name.size() );
+		offset += item.name.size();
+	}
+
+	const char padding[ ItemAlignment ] = {};
+	std::vector<char> buffer;
+	for ( auto& item : items )
+	{
+		out.WriteBytes( padding, static_cast<size_t>( item.entry.offset - offset ) );
+
+		buffer.resize( static_cast<size_t>( item.entry.size ) );
+		std::ifstream in( item.path, std::ios::binary );
+		if ( !in.read( buffer.data(), buffer.size() ) )
+		{
+			dbLogWarning( "BuildInventoryPack() cannot read [%s]", item.path.string().c_str() );
+			return false;
+		}
+
+		out.WriteBytes( buffer.data(), buffer.size() );
+		offset = item.entry.offset + item.entry.size;
+	}
+
+	dbLog( "BuildInventoryPack( %s ) packed %zu items into [%s]", directory.c_str(), items.size(), filename.c_str() );
+	return true;
+}
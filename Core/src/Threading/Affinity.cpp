@@ -0,0 +1,158 @@
+#include "Threading/Affinity.h"
+
+#include <stdx/assert.h>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+
+#include <fstream>
+#include <string>
+#endif
+
+namespace Threading
+{
+
+#if defined( __linux__ )
+
+namespace
+{
+	// parses the kernel's cpu list format, e.g. "0-3,8,10-11"
+	CpuSet ParseCpuList( const std::string& list )
+	{
+		CpuSet cpus;
+		size_t pos = 0;
+		while ( pos < list.size() )
+		{
+			size_t end = list.find( ',', pos );
+			if ( end == std::string::npos )
+				end = list.size();
+
+			const std::string range = list.substr( pos, end - pos );
+			const size_t dash = range.find( '-' );
+
+			try
+			{
+				const auto first = static_cast<uint32_t>( std::stoul( range.substr( 0, dash ) ) );
+				const auto last = ( dash == std::string::npos ) ? first : static_cast<uint32_t>( std::stoul( range.substr( dash + 1 ) ) );
+				for ( uint32_t cpu = first; cpu <= last; ++cpu )
+					cpus.push_back( cpu );
+			}
+			catch ( const std::exception& )
+			{
+				// blank line or trailing newline
+			}
+
+			pos = end + 1;
+		}
+		return cpus;
+	}
+}
+
+bool SetThreadAffinity( std::thread& thread, const CpuSet& cpus )
+{
+	dbAssert( thread.joinable() );
+
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	for ( uint32_t cpu : cpus )
+	{
+		if ( cpu < CPU_SETSIZE )
+			CPU_SET( cpu, &set );
+	}
+
+	if ( CPU_COUNT( &set ) == 0 )
+		return false;
+
+	return pthread_setaffinity_np( thread.native_handle(), sizeof( set ), &set ) == 0;
+}
+
+uint32_t GetNumaNodeCount()
+{
+	std::ifstream fin( "/sys/devices/system/node/online" );
+	std::string list;
+	if ( !std::getline( fin, list ) )
+		return 1;
+
+	const CpuSet nodes = ParseCpuList( list );
+	return nodes.empty() ? 1 : static_cast<uint32_t>( nodes.back() + 1 );
+}
+
+CpuSet GetNumaNodeCpus( uint32_t node )
+{
+	std::ifstream fin( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+	std::string list;
+	if ( !std::getline( fin, list ) )
+		return {};
+
+	return ParseCpuList( list );
+}
+
+#elif defined( _WIN32 )
+
+bool SetThreadAffinity( std::thread& thread, const CpuSet& cpus )
+{
+	dbAssert( thread.joinable() );
+
+	// only the calling process's processor group is supported
+	DWORD_PTR mask = 0;
+	for ( uint32_t cpu : cpus )
+	{
+		if ( cpu < sizeof( DWORD_PTR ) * 8 )
+			mask |= DWORD_PTR( 1 ) << cpu;
+	}
+
+	if ( mask == 0 )
+		return false;
+
+	return SetThreadAffinityMask( static_cast<HANDLE>( thread.native_handle() ), mask ) != 0;
+}
+
+uint32_t GetNumaNodeCount()
+{
+	ULONG highestNode = 0;
+	if ( !GetNumaHighestNodeNumber( &highestNode ) )
+		return 1;
+
+	return static_cast<uint32_t>( highestNode + 1 );
+}
+
+CpuSet GetNumaNodeCpus( uint32_t node )
+{
+	GROUP_AFFINITY affinity{};
+	if ( !GetNumaNodeProcessorMaskEx( static_cast<USHORT>( node ), &affinity ) )
+		return {};
+
+	CpuSet cpus;
+	for ( uint32_t cpu = 0; cpu < sizeof( KAFFINITY ) * 8; ++cpu )
+	{
+		if ( affinity.Mask & ( KAFFINITY( 1 ) << cpu ) )
+			cpus.push_back( cpu );
+	}
+	return cpus;
+}
+
+#else
+
+bool SetThreadAffinity( std::thread&, const CpuSet& )
+{
+	return false;
+}
+
+uint32_t GetNumaNodeCount()
+{
+	return 1;
+}
+
+CpuSet GetNumaNodeCpus( uint32_t )
+{
+	return {};
+}
+
+#endif
+
+} // namespace Threading
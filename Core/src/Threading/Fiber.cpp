@@ -0,0 +1,209 @@
+#include "Threading/Fiber.h"
+
+#include <stdx/assert.h>
+
+#if defined( _WIN32 )
+#define NOMINMAX
+#include <Windows.h>
+#elif __has_include( <ucontext.h> ) && __has_include( <sys/mman.h> )
+#define CORE_FIBER_UCONTEXT
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+namespace Threading::Detail
+{
+
+namespace
+{
+	// only touched outside fibers or right around a switch, never cached across one
+	thread_local Fiber* t_currentFiber = nullptr;
+}
+
+void Fiber::Run()
+{
+	for (;;)
+	{
+		m_task();
+		m_task = nullptr;
+		m_finished = true;
+		Suspend();
+	}
+}
+
+void Fiber::Start( Fiber* fiber )
+{
+	fiber->Run();
+}
+
+bool IsRunningOnFiber() noexcept
+{
+	return t_currentFiber != nullptr;
+}
+
+bool SuspendFiber( const std::atomic<uint32_t>& value, uint32_t old )
+{
+	Fiber* fiber = t_currentFiber;
+	if ( fiber == nullptr )
+		return false;
+
+	// the worker registers the fiber for wake up after switching away, so a notify cannot resume it early
+	fiber->m_parkValue = &value;
+	fiber->m_parkOld = old;
+	fiber->Suspend();
+	return true;
+}
+
+#if defined( _WIN32 )
+
+namespace
+{
+	void WINAPI FiberProc( void* parameter )
+	{
+		Fiber::Start( static_cast<Fiber*>( parameter ) );
+	}
+}
+
+Fiber* Fiber::Create( size_t stackSize, void* userData )
+{
+	auto* fiber = new Fiber();
+	fiber->m_userData = userData;
+	fiber->m_context = ::CreateFiberEx( 0, stackSize, FIBER_FLAG_FLOAT_SWITCH, &FiberProc, fiber );
+	if ( fiber->m_context == nullptr )
+	{
+		dbLogWarning( "Fiber::Create() failed [%u]", static_cast<unsigned>( ::GetLastError() ) );
+		delete fiber;
+		return nullptr;
+	}
+
+	return fiber;
+}
+
+Fiber::~Fiber()
+{
+	if ( m_context )
+		::DeleteFiber( m_context );
+}
+
+bool Fiber::Resume()
+{
+	// workers stay converted for their lifetime
+	void* self = ::IsThreadAFiber() ? ::GetCurrentFiber() : ::ConvertThreadToFiberEx( nullptr, FIBER_FLAG_FLOAT_SWITCH );
+	dbAssert( self );
+
+	m_returnContext = self;
+	m_parkValue = nullptr;
+	t_currentFiber = this;
+	::SwitchToFiber( m_context );
+	t_currentFiber = nullptr;
+
+	return m_finished;
+}
+
+void Fiber::Suspend()
+{
+	::SwitchToFiber( m_returnContext );
+}
+
+#elif defined( CORE_FIBER_UCONTEXT )
+
+namespace
+{
+	// makecontext only passes ints, so the pointer is split in two
+	void FiberEntry( unsigned int high, unsigned int low )
+	{
+		const uintptr_t address = ( static_cast<uintptr_t>( high ) << 32 ) | static_cast<uintptr_t>( low );
+		Fiber::Start( reinterpret_cast<Fiber*>( address ) );
+	}
+}
+
+Fiber* Fiber::Create( size_t stackSize, void* userData )
+{
+	const auto pageSize = static_cast<size_t>( ::sysconf( _SC_PAGESIZE ) );
+	const size_t usableSize = ( stackSize + pageSize - 1 ) / pageSize * pageSize;
+	const size_t mappingSize = usableSize + pageSize;
+
+	void* stack = ::mmap( nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 );
+	if ( stack == MAP_FAILED )
+	{
+		dbLogWarning( "Fiber::Create() could not map a %zu byte stack", mappingSize );
+		return nullptr;
+	}
+
+	// stacks grow down, so the guard page goes at the bottom
+	if ( ::mprotect( stack, pageSize, PROT_NONE ) != 0 )
+	{
+		::munmap( stack, mappingSize );
+		return nullptr;
+	}
+
+	auto* fiber = new Fiber();
+	fiber->m_userData = userData;
+	fiber->m_stack = stack;
+	fiber->m_stackMappingSize = mappingSize;
+
+	auto* context = new ucontext_t();
+	fiber->m_context = context;
+	::getcontext( context );
+	context->uc_stack.ss_sp = static_cast<char*>( stack ) + pageSize;
+	context->uc_stack.ss_size = usableSize;
+	context->uc_link = nullptr;
+
+	const auto address = reinterpret_cast<uintptr_t>( fiber );
+	::makecontext( context, reinterpret_cast<void( * )()>( &FiberEntry ), 2,
+		static_cast<unsigned int>( static_cast<uint64_t>( address ) >> 32 ),
+		static_cast<unsigned int>( address & 0xffffffff ) );
+
+	return fiber;
+}
+
+Fiber::~Fiber()
+{
+	delete static_cast<ucontext_t*>( m_context );
+
+	if ( m_stack )
+		::munmap( m_stack, m_stackMappingSize );
+}
+
+bool Fiber::Resume()
+{
+	ucontext_t caller;
+	m_returnContext = &caller;
+	m_parkValue = nullptr;
+	t_currentFiber = this;
+	::swapcontext( &caller, static_cast<ucontext_t*>( m_context ) );
+	t_currentFiber = nullptr;
+
+	return m_finished;
+}
+
+void Fiber::Suspend()
+{
+	// m_returnContext belongs to whichever worker resumed this fiber last
+	::swapcontext( static_cast<ucontext_t*>( m_context ), static_cast<ucontext_t*>( m_returnContext ) );
+}
+
+#else
+
+Fiber* Fiber::Create( size_t, void* )
+{
+	return nullptr;
+}
+
+Fiber::~Fiber() = default;
+
+bool Fiber::Resume()
+{
+	dbBreak();
+	return true;
+}
+
+void Fiber::Suspend()
+{
+	dbBreak();
+}
+
+#endif
+
+} // namespace Threading::Detail
@@ -0,0 +1,198 @@
+#include "Threading/TaskGraph.h"
+
+#include <algorithm>
+
+namespace Threading
+{
+
+TaskGraph::NodeId TaskGraph::AddNode( Work work, std::string_view name )
+{
+	dbAssert( !IsRunning() );
+	dbAssert( work );
+
+	const auto id = static_cast<NodeId>( m_nodes.size() );
+	m_nodes.emplace_back( std::move( work ), nullptr, name );
+	m_rootsDirty = true;
+	return id;
+}
+
+TaskGraph::NodeId TaskGraph::AddSubgraph( TaskGraph& subgraph, std::string_view name )
+{
+	dbAssert( !IsRunning() );
+	dbAssert( &subgraph != this );
+	dbAssertMessage( subgraph.m_parent == nullptr, "subgraph already belongs to a graph" );
+
+	const auto id = static_cast<NodeId>( m_nodes.size() );
+	m_nodes.emplace_back( nullptr, &subgraph, name );
+	m_rootsDirty = true;
+
+	subgraph.m_parent = this;
+	subgraph.m_parentNode = id;
+	return id;
+}
+
+void TaskGraph::AddEdge( NodeId from, NodeId to )
+{
+	dbAssert( !IsRunning() );
+	dbAssert( from < m_nodes.size() && to < m_nodes.size() );
+	dbAssert( from != to );
+
+	auto& successors = m_nodes[ from ].successors;
+	if ( std::find( successors.begin(), successors.end(), to ) != successors.end() )
+		return;
+
+	successors.push_back( to );
+	++m_nodes[ to ].predecessorCount;
+	m_rootsDirty = true;
+}
+
+bool TaskGraph::Validate() const
+{
+	// Kahn's algorithm. Every node is visited once if there is no cycle
+	std::vector<uint32_t> pending( m_nodes.size() );
+	std::vector<NodeId> ready;
+	for ( NodeId i = 0; i < m_nodes.size(); ++i )
+	{
+		pending[ i ] = m_nodes[ i ].predecessorCount;
+		if ( pending[ i ] == 0 )
+			ready.push_back( i );
+	}
+
+	size_t visited = 0;
+	while ( !ready.empty() )
+	{
+		const NodeId node = ready.back();
+		ready.pop_back();
+		++visited;
+
+		for ( NodeId successor : m_nodes[ node ].successors )
+		{
+			if ( --pending[ successor ] == 0 )
+				ready.push_back( successor );
+		}
+	}
+
+	return visited == m_nodes.size();
+}
+
+void TaskGraph::Wait()
+{
+	// Complete() always notifies, so there is no waiting flag to set. It only notifies the parking buckets since the
+	// graph may be gone by then, so never wait through std::atomic::wait
+	Detail::HelpingWait( m_running,
+		[ this ] { return !IsRunning(); },
+		[ this ] { return m_running.load( std::memory_order_acquire ); },
+		nullptr,
+		true );
+
+	if ( m_failed.load( std::memory_order_acquire ) )
+		std::rethrow_exception( m_error );
+}
+
+void TaskGraph::Reset()
+{
+	if ( m_rootsDirty )
+	{
+		m_roots.clear();
+		for ( NodeId i = 0; i < m_nodes.size(); ++i )
+		{
+			if ( m_nodes[ i ].predecessorCount == 0 )
+				m_roots.push_back( i );
+		}
+		m_rootsDirty = false;
+	}
+
+	for ( auto& node : m_nodes )
+		node.pending.store( node.predecessorCount, std::memory_order_relaxed );
+
+	m_failed.store( false, std::memory_order_relaxed );
+	m_error = nullptr;
+	m_remaining.store( m_nodes.size(), std::memory_order_relaxed );
+	m_startTime = Now();
+	m_endTime = m_startTime;
+
+	// publishes the counters to the threads the roots are scheduled on
+	m_running.store( 1, std::memory_order_release );
+}
+
+TaskGraph::CriticalPath TaskGraph::GetCriticalPath() const
+{
+	dbAssert( !IsRunning() );
+
+	CriticalPath path;
+	if ( m_nodes.empty() )
+		return path;
+
+	// longest path by node run time, relaxed in topological order
+	const size_t count = m_nodes.size();
+	std::vector<uint64_t> finish( count, 0 );
+	std::vector<NodeId> previous( count, InvalidNode );
+	std::vector<uint32_t> pending( count );
+	std::vector<NodeId> ready;
+
+	for ( NodeId i = 0; i < count; ++i )
+	{
+		pending[ i ] = m_nodes[ i ].predecessorCount;
+		if ( pending[ i ] == 0 )
+			ready.push_back( i );
+	}
+
+	while ( !ready.empty() )
+	{
+		const NodeId node = ready.back();
+		ready.pop_back();
+
+		const auto& data = m_nodes[ node ];
+		finish[ node ] += data.endTime - data.startTime;
+
+		for ( NodeId successor : data.successors )
+		{
+			if ( finish[ node ] > finish[ successor ] || previous[ successor ] == InvalidNode )
+			{
+				finish[ successor ] = finish[ node ];
+				previous[ successor ] = node;
+			}
+
+			if ( --pending[ successor ] == 0 )
+				ready.push_back( successor );
+		}
+	}
+
+	NodeId last = static_cast<NodeId>( std::max_element( finish.begin(), finish.end() ) - finish.begin() );
+	path.nanoseconds = finish[ last ];
+
+	for ( NodeId node = last; node != InvalidNode; node = previous[ node ] )
+		path.nodes.push_back( node );
+
+	std::reverse( path.nodes.begin(), path.nodes.end() );
+	return path;
+}
+
+void TaskGraph::LogCriticalPath( std::ostream& out ) const
+{
+	constexpr double NanoSecondsPerMillisecond = 1000000.0;
+
+	const auto path = GetCriticalPath();
+	const uint64_t wallTime = GetLastRunNanoseconds();
+
+	out << "critical path: " << path.nanoseconds / NanoSecondsPerMillisecond << "ms of " << wallTime / NanoSecondsPerMillisecond << "ms\n";
+
+	for ( NodeId node : path.nodes )
+	{
+		const auto& data = m_nodes[ node ];
+		const uint64_t time = data.endTime - data.startTime;
+		const double percentTime = path.nanoseconds ? 100.0 * time / path.nanoseconds : 0.0;
+
+		out << '\t' << percentTime << "%: ";
+		if ( data.name.empty() )
+			out << "node " << node;
+		else
+			out << data.name;
+
+		out << " (" << time / NanoSecondsPerMillisecond << "ms)\n";
+	}
+
+	out << '\n';
+}
+
+} // namespace Threading
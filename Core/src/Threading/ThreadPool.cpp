@@ -1,3 +1,832 @@
 #include "Threading/ThreadPool.h"
 
-Threading::ThreadPool Threading::StaticThreadPool;
\ No newline at end of file
+#include "Threading/AtomicWait.h"
+
+#ifndef SHIPPING
+#include <fstream>
+#endif
+
+namespace Threading
+{
+
+namespace
+{
+	struct CurrentWorker
+	{
+		const ThreadPool* pool = nullptr;
+		size_t index = 0;
+	};
+
+	thread_local CurrentWorker t_currentWorker;
+
+	// xorshift32. Only used to pick steal victims so quality does not matter
+	uint32_t NextRandom( uint32_t& state ) noexcept
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+}
+
+ThreadPool::ThreadPool( size_t threadCount, SchedulingMode mode, std::optional<FiberOptions> fibers )
+	: ThreadPool( threadCount, std::nullopt, mode, std::move( fibers ) )
+{}
+
+ThreadPool::ThreadPool( const ElasticOptions& elastic, SchedulingMode mode, std::optional<FiberOptions> fibers )
+	: ThreadPool( elastic.maxThreads, elastic, mode, std::move( fibers ) )
+{}
+
+ThreadPool::ThreadPool( size_t slotCount, std::optional<ElasticOptions> elastic, SchedulingMode mode, std::optional<FiberOptions> fibers )
+	: m_mode( mode )
+	, m_threadCount( std::max<size_t>( slotCount, 1 ) )
+	, m_fiberOptions( fibers )
+#ifndef SHIPPING
+	, m_metrics( m_threadCount )
+#endif
+{
+	const size_t threadCount = m_threadCount;
+
+	if ( m_mode == SchedulingMode::WorkStealing )
+	{
+		m_workerQueues = std::make_unique<WorkerQueue[]>( threadCount );
+		for ( size_t i = 0; i < threadCount; ++i )
+			m_workerQueues[ i ].randomState = static_cast<uint32_t>( i * 2654435761u + 1 );
+	}
+
+	if ( m_fiberOptions )
+		m_freeFibers = std::make_unique<std::vector<Detail::Fiber*>[]>( threadCount );
+
+	m_slotActive = std::make_unique<bool[]>( threadCount );
+	m_threads.resize( threadCount );
+
+	std::lock_guard lock( m_mutex );
+
+	if ( elastic )
+	{
+		m_isElastic = true;
+		m_spinNanoseconds = std::make_unique<int64_t[]>( threadCount );
+		SetElasticOptionsLocked( *elastic );
+		m_monitor = std::thread( [ this ] { RunMonitor(); } );
+	}
+	else
+	{
+		for ( size_t i = 0; i < threadCount; ++i )
+			SpawnWorkerLocked();
+	}
+}
+
+void ThreadPool::SpawnWorkerLocked()
+{
+	size_t index = 0;
+	while ( index < m_threadCount && m_slotActive[ index ] )
+		++index;
+
+	if ( index == m_threadCount )
+		return;
+
+	// a retired worker has already released the slot and only has to return
+	if ( m_threads[ index ].joinable() )
+		m_threads[ index ].join();
+
+	m_slotActive[ index ] = true;
+	++m_activeThreads;
+
+	m_threads[ index ] = std::thread( [ this, index ] { RunWorker( index ); } );
+
+	if ( !m_affinity.empty() )
+	{
+		if ( m_pinEachWorker )
+			SetThreadAffinity( m_threads[ index ], { m_affinity[ index % m_affinity.size() ] } );
+		else
+			SetThreadAffinity( m_threads[ index ], m_affinity );
+	}
+}
+
+void ThreadPool::RunWorker( size_t workerIndex )
+{
+	t_currentWorker = { this, workerIndex };
+
+	// futures waited on from inside a task run other queued tasks meanwhile
+	Detail::t_waitHelper = { []( void* pool ) { return static_cast<ThreadPool*>( pool )->TryRunPendingTask(); }, this };
+
+	if ( m_mode == SchedulingMode::WorkStealing )
+		RunWorkStealingWorker( workerIndex );
+	else
+		RunSharedQueueWorker( workerIndex );
+
+	Detail::t_waitHelper = {};
+	t_currentWorker = {};
+}
+
+ThreadPool::~ThreadPool()
+{
+	dbLog( "killing threads" );
+	JoinWithSignal( Signal::Kill );
+
+	// queued tasks are destroyed while the pool is still whole, without failing their futures. Continuations run
+	// from here could post back into the pool
+	std::vector<Entry> dropped;
+	const auto all = []( const Entry& ) { return true; };
+	m_taskQueue.RemoveIf( all, dropped );
+	for ( size_t i = 0; m_workerQueues && i < m_threadCount; ++i )
+		m_workerQueues[ i ].tasks.RemoveIf( all, dropped );
+
+	dropped.clear();
+
+	// fibers still suspended at this point are leaked. Their stacks hold live objects that cannot be unwound
+	for ( size_t i = 0; m_freeFibers && i < m_threadCount; ++i )
+	{
+		for ( auto* fiber : m_freeFibers[ i ] )
+			delete fiber;
+	}
+}
+
+void ThreadPool::QueueTask( Task task, int priority, CancellationToken token )
+{
+	Entry entry( std::move( task ), priority, std::move( token ) );
+
+	if ( m_isElastic )
+		entry.queuedAt = Detail::WaitClock::now().time_since_epoch().count();
+
+#ifndef SHIPPING
+	if ( m_metrics.IsEnabled() )
+	{
+		entry.enqueueTime = Detail::ThreadPoolMetrics::Now();
+		m_metrics.OnQueued( GetPriorityBand( priority ) );
+	}
+#endif
+
+	if ( m_mode == SchedulingMode::WorkStealing && t_currentWorker.pool == this )
+	{
+		// local push from inside a task. No shared lock is touched
+		auto& queue = m_workerQueues[ t_currentWorker.index ];
+		{
+			std::lock_guard lock( queue.mutex );
+			queue.tasks.Push( GetPriorityBand( priority ), std::move( entry ) );
+			++m_pendingTasks;
+		}
+
+		WakeWorker();
+
+		if ( m_isElastic )
+			WakeMonitor();
+		return;
+	}
+
+	{
+		std::lock_guard lock( m_mutex );
+		m_taskQueue.Push( GetPriorityBand( priority ), std::move( entry ) );
+		++m_sharedTasks;
+		++m_pendingTasks;
+	}
+
+	m_condition.notify_one();
+
+	if ( m_isElastic )
+		WakeMonitor();
+}
+
+void ThreadPool::QueueTasks( Task* tasks, size_t count, int priority )
+{
+	if ( count == 0 )
+		return;
+
+	const size_t band = GetPriorityBand( priority );
+	const int64_t queuedAt = m_isElastic ? Detail::WaitClock::now().time_since_epoch().count() : 0;
+
+#ifndef SHIPPING
+	uint64_t enqueueTime = 0;
+	if ( m_metrics.IsEnabled() )
+	{
+		enqueueTime = Detail::ThreadPoolMetrics::Now();
+		for ( size_t i = 0; i < count; ++i )
+			m_metrics.OnQueued( band );
+	}
+#endif
+
+	const auto pushAll = [ & ]( BandedQueue<Entry, PriorityBandCount>& queue )
+	{
+		for ( size_t i = 0; i < count; ++i )
+		{
+			Entry entry( std::move( tasks[ i ] ), priority, CancellationToken() );
+			entry.queuedAt = queuedAt;
+#ifndef SHIPPING
+			entry.enqueueTime = enqueueTime;
+#endif
+			queue.Push( band, std::move( entry ) );
+		}
+	};
+
+	if ( m_mode == SchedulingMode::WorkStealing && t_currentWorker.pool == this )
+	{
+		// idle workers steal the rest of the batch from this worker
+		auto& queue = m_workerQueues[ t_currentWorker.index ];
+		{
+			std::lock_guard lock( queue.mutex );
+			pushAll( queue.tasks );
+			m_pendingTasks += count;
+		}
+
+		WakeWorkers( count );
+
+		if ( m_isElastic )
+			WakeMonitor();
+		return;
+	}
+
+	{
+		std::lock_guard lock( m_mutex );
+		pushAll( m_taskQueue );
+		m_sharedTasks += count;
+		m_pendingTasks += count;
+	}
+
+	if ( count >= m_threadCount )
+		m_condition.notify_all();
+	else
+		for ( size_t i = 0; i < count; ++i )
+			m_condition.notify_one();
+
+	if ( m_isElastic )
+		WakeMonitor();
+}
+
+size_t ThreadPool::RemoveCancelledTasks()
+{
+	const auto isCancelled = []( const Entry& entry ) { return entry.token.IsCancellationRequested(); };
+
+	// destroying a task can run continuations that queue more work, so it happens outside the locks
+	std::vector<Entry> removed;
+	{
+		std::lock_guard lock( m_mutex );
+		const size_t count = m_taskQueue.RemoveIf( isCancelled, removed );
+		m_sharedTasks -= count;
+		m_pendingTasks -= count;
+	}
+
+	for ( size_t i = 0; m_workerQueues && i < m_threadCount; ++i )
+	{
+		std::lock_guard lock( m_workerQueues[ i ].mutex );
+		m_pendingTasks -= m_workerQueues[ i ].tasks.RemoveIf( isCancelled, removed );
+	}
+
+	for ( auto& entry : removed )
+	{
+#ifndef SHIPPING
+		m_metrics.OnDropped( GetPriorityBand( entry.priority ), entry.enqueueTime );
+#endif
+		Detail::DropTask( std::move( entry.task ) );
+	}
+
+	return removed.size();
+}
+
+void ThreadPool::SetPriorityAging( std::chrono::nanoseconds interval )
+{
+	{
+		std::lock_guard lock( m_mutex );
+		m_taskQueue.SetAgingInterval( interval );
+	}
+
+	for ( size_t i = 0; m_workerQueues && i < m_threadCount; ++i )
+	{
+		std::lock_guard lock( m_workerQueues[ i ].mutex );
+		m_workerQueues[ i ].tasks.SetAgingInterval( interval );
+	}
+}
+
+bool ThreadPool::SetAffinity( const CpuSet& cpus, bool pinEachWorker )
+{
+	if ( cpus.empty() )
+		return false;
+
+	std::lock_guard lock( m_mutex );
+	m_affinity = cpus;
+	m_pinEachWorker = pinEachWorker;
+
+	bool pinned = true;
+	for ( size_t i = 0; i < m_threads.size(); ++i )
+	{
+		if ( !m_slotActive[ i ] )
+			continue;
+
+		if ( pinEachWorker )
+			pinned &= SetThreadAffinity( m_threads[ i ], { cpus[ i % cpus.size() ] } );
+		else
+			pinned &= SetThreadAffinity( m_threads[ i ], cpus );
+	}
+
+	return pinned;
+}
+
+void ThreadPool::SetElasticOptions( const ElasticOptions& options )
+{
+	std::lock_guard lock( m_mutex );
+	if ( !m_elastic )
+	{
+		dbLogWarning( "ThreadPool::SetElasticOptions() called on a fixed size pool" );
+		return;
+	}
+
+	SetElasticOptionsLocked( options );
+	m_monitorCondition.notify_one();
+}
+
+ElasticOptions ThreadPool::GetElasticOptions() const
+{
+	std::lock_guard lock( m_mutex );
+	if ( m_elastic )
+		return *m_elastic;
+
+	ElasticOptions options;
+	options.minThreads = m_threadCount;
+	options.maxThreads = m_threadCount;
+	return options;
+}
+
+void ThreadPool::SetElasticOptionsLocked( const ElasticOptions& options )
+{
+	if ( m_elastic )
+		*m_elastic = options;
+	else
+		m_elastic.emplace( options );
+
+	auto& elastic = *m_elastic;
+	elastic.maxThreads = std::clamp<size_t>( elastic.maxThreads, 1, m_threadCount );
+	elastic.minThreads = std::clamp<size_t>( elastic.minThreads, 1, elastic.maxThreads );
+
+	m_maxSpinNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( elastic.maxSpin ).count();
+
+	if ( m_signal != Signal::Run )
+		return;
+
+	while ( m_activeThreads < elastic.minThreads )
+		SpawnWorkerLocked();
+}
+
+bool ThreadPool::IsWorkerThread() const noexcept
+{
+	return t_currentWorker.pool == this;
+}
+
+bool ThreadPool::TryRunPendingTask()
+{
+	// a fiber suspends instead of helping, and resuming another fiber from inside one is not supported
+	if ( t_currentWorker.pool != this || Detail::IsRunningOnFiber() )
+		return false;
+
+	const size_t workerIndex = t_currentWorker.index;
+
+	// the newest task is most likely the one being waited on, and running it first keeps nesting shallow
+	Entry entry;
+	const bool popped = ( m_mode == SchedulingMode::WorkStealing )
+		? ( TryPopLocal( workerIndex, entry ) || TryPopShared( entry ) || TrySteal( workerIndex, entry ) )
+		: TryPopShared( entry, true );
+
+	if ( !popped )
+		return false;
+
+	RunTask( entry, workerIndex );
+	return true;
+}
+
+void ThreadPool::Join()
+{
+	dbLog( "waiting to finish tasks" );
+	JoinWithSignal( Signal::Stop );
+}
+
+void ThreadPool::RunSharedQueueWorker( size_t workerIndex )
+{
+	for(;;)
+	{
+		Entry entry;
+
+		if ( m_sharedTasks == 0 )
+			SpinForWork( workerIndex );
+
+		{
+			std::unique_lock lock( m_mutex );
+
+			// stopping waits for unfinished fibers. Suspended ones come back through the queue once woken
+			const bool hasWork = WaitForWork( lock, [this] { return m_signal == Signal::Kill || !m_taskQueue.Empty() || ( m_signal == Signal::Stop && m_activeFibers == 0 ); } );
+
+			if ( !hasWork || m_taskQueue.Empty() || m_signal == Signal::Kill )
+			{
+				return;
+			}
+
+			entry = Pop();
+			--m_sharedTasks;
+			--m_pendingTasks;
+		}
+
+		RunTask( entry, workerIndex );
+	}
+}
+
+void ThreadPool::RunWorkStealingWorker( size_t workerIndex )
+{
+	for(;;)
+	{
+		Entry entry;
+
+		if ( TryPopLocal( workerIndex, entry ) || TryPopShared( entry ) || TrySteal( workerIndex, entry ) )
+		{
+			RunTask( entry, workerIndex );
+			continue;
+		}
+
+		if ( SpinForWork( workerIndex ) )
+			continue;
+
+		std::unique_lock lock( m_mutex );
+
+		if ( m_signal == Signal::Kill || ( m_signal == Signal::Stop && m_pendingTasks == 0 && m_activeFibers == 0 ) )
+			return;
+
+		// a task pushed to a worker deque bumps m_pendingTasks before checking m_sleepingWorkers,
+		// so either we see the task here or the pusher sees us sleeping and notifies
+		if ( !WaitForWork( lock, [this] { return m_signal == Signal::Kill || m_pendingTasks > 0 || ( m_signal == Signal::Stop && m_activeFibers == 0 ); } ) )
+			return;
+
+		if ( m_signal == Signal::Kill )
+			return;
+	}
+}
+
+template <typename Ready>
+bool ThreadPool::WaitForWork( std::unique_lock<std::mutex>& lock, Ready&& ready )
+{
+	++m_sleepingWorkers;
+
+	bool retire = false;
+	if ( !m_elastic )
+	{
+		m_condition.wait( lock, ready );
+	}
+	else
+	{
+		while ( !m_condition.wait_for( lock, m_elastic->retireAfter, ready ) )
+		{
+			if ( m_activeThreads > m_elastic->minThreads )
+			{
+				retire = true;
+				break;
+			}
+		}
+	}
+
+	--m_sleepingWorkers;
+
+	if ( retire )
+	{
+		// the slot is reused by the next spawn, which joins this thread
+		m_slotActive[ t_currentWorker.index ] = false;
+		--m_activeThreads;
+	}
+
+	return !retire;
+}
+
+bool ThreadPool::SpinForWork( size_t workerIndex )
+{
+	const int64_t maxSpin = m_maxSpinNanoseconds.load( std::memory_order_relaxed );
+	if ( maxSpin <= 0 )
+		return false;
+
+	static constexpr int64_t MinSpin = 1000;
+	int64_t& spin = m_spinNanoseconds[ workerIndex ];
+	spin = std::clamp( spin, std::min( MinSpin, maxSpin ), maxSpin );
+
+	++m_spinningWorkers;
+
+	const auto start = Detail::WaitClock::now();
+	const auto end = start + std::chrono::nanoseconds( spin );
+	bool found = false;
+	do
+	{
+		for ( int i = 0; i < 16; ++i )
+			Detail::CpuRelax();
+
+		if ( m_pendingTasks > 0 )
+		{
+			found = true;
+			break;
+		}
+	}
+	while ( Detail::WaitClock::now() < end );
+
+	--m_spinningWorkers;
+
+	// spin longer while it keeps paying off, back off when the worker ends up sleeping anyway
+	spin = found ? std::min( spin * 2, maxSpin ) : spin / 2;
+	return found;
+}
+
+void ThreadPool::RunMonitor()
+{
+	std::unique_lock lock( m_mutex );
+
+	for(;;)
+	{
+		const auto stalled = [ this ]
+		{
+			return m_pendingTasks > 0 && m_sleepingWorkers + m_spinningWorkers == 0 && m_activeThreads < m_elastic->maxThreads;
+		};
+
+		// sleep until tasks queue up with every worker busy. The flag tells producers they have to wake us
+		m_monitorSleeping = true;
+		m_monitorCondition.wait( lock, [ & ] { return m_signal != Signal::Run || stalled(); } );
+		m_monitorSleeping = false;
+
+		if ( m_signal != Signal::Run )
+			return;
+
+		const auto growAfter = m_elastic->growAfter;
+		const auto stalledAt = Detail::WaitClock::now();
+		m_longestQueueWait.store( 0, std::memory_order_relaxed );
+
+		m_monitorCondition.wait_until( lock, stalledAt + growAfter, [ this ] { return m_signal != Signal::Run; } );
+		if ( m_signal != Signal::Run )
+			return;
+
+		// the tasks queued at the stall have waited growAfter if none started since. Otherwise a task that did
+		// start must have waited that long, a steady trickle of starts does not hide a queue that keeps growing
+		const bool noneStarted = m_lastTaskStart.load( std::memory_order_relaxed ) <= stalledAt.time_since_epoch().count();
+		const auto longestWait = Detail::WaitClock::duration( m_longestQueueWait.load( std::memory_order_relaxed ) );
+		if ( stalled() && ( noneStarted || longestWait >= growAfter ) )
+		{
+			dbLog( "thread pool growing to %zu workers", m_activeThreads.load() + 1 );
+			SpawnWorkerLocked();
+		}
+	}
+}
+
+void ThreadPool::WakeMonitor()
+{
+	// only the monitor sleeping without a timeout can miss a task, everything else polls
+	if ( m_monitorSleeping && m_sleepingWorkers + m_spinningWorkers == 0 )
+	{
+		{
+			std::lock_guard lock( m_mutex );
+		}
+		m_monitorCondition.notify_one();
+	}
+}
+
+bool ThreadPool::TryPopLocal( size_t workerIndex, Entry& entry )
+{
+	auto& queue = m_workerQueues[ workerIndex ];
+	std::lock_guard lock( queue.mutex );
+
+	if ( queue.tasks.Empty() )
+		return false;
+
+	// a task queued from outside the pool goes first if it outranks everything local, after aging.
+	// The shared lock is only ever taken inside a worker's lock, never the other way around
+	if ( m_sharedTasks > 0 )
+	{
+		std::lock_guard sharedLock( m_mutex );
+		if ( m_taskQueue.GetTopRank() < queue.tasks.GetTopRank() )
+		{
+			entry = Pop();
+			--m_sharedTasks;
+			--m_pendingTasks;
+			return true;
+		}
+	}
+
+	entry = queue.tasks.PopNewest();
+	--m_pendingTasks;
+	return true;
+}
+
+bool ThreadPool::TryPopShared( Entry& entry, bool newest )
+{
+	if ( m_sharedTasks == 0 )
+		return false;
+
+	std::lock_guard lock( m_mutex );
+
+	if ( m_taskQueue.Empty() )
+		return false;
+
+	entry = newest ? m_taskQueue.PopNewest() : Pop();
+	--m_sharedTasks;
+	--m_pendingTasks;
+	return true;
+}
+
+bool ThreadPool::TrySteal( size_t workerIndex, Entry& entry )
+{
+	const size_t workerCount = m_threadCount;
+	if ( workerCount < 2 || m_pendingTasks == 0 )
+		return false;
+
+	auto& self = m_workerQueues[ workerIndex ];
+	const size_t start = NextRandom( self.randomState ) % workerCount;
+
+	for ( size_t i = 0; i < workerCount; ++i )
+	{
+		const size_t victimIndex = ( start + i ) % workerCount;
+		if ( victimIndex == workerIndex )
+			continue;
+
+		// never block on a busy victim, just move on to the next one
+		auto& victim = m_workerQueues[ victimIndex ];
+		std::unique_lock lock( victim.mutex, std::try_to_lock );
+		if ( !lock.owns_lock() )
+			continue;
+
+		if ( !victim.tasks.Empty() )
+		{
+			entry = victim.tasks.Pop();
+			--m_pendingTasks;
+
+#ifndef SHIPPING
+			if ( m_metrics.IsEnabled() )
+				m_metrics.OnSteal( workerIndex );
+#endif
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::RunTask( Entry& entry, size_t workerIndex )
+{
+	if ( m_isElastic )
+	{
+		const int64_t now = Detail::WaitClock::now().time_since_epoch().count();
+		m_lastTaskStart.store( now, std::memory_order_relaxed );
+
+		// fibers being resumed were not queued by QueueTask() and have no queue time
+		const int64_t waited = entry.queuedAt != 0 ? now - entry.queuedAt : 0;
+		int64_t longest = m_longestQueueWait.load( std::memory_order_relaxed );
+		while ( waited > longest && !m_longestQueueWait.compare_exchange_weak( longest, waited, std::memory_order_relaxed ) ) {}
+	}
+
+	if ( entry.fiber )
+	{
+		ResumeFiber( entry.fiber, workerIndex );
+		return;
+	}
+
+	if ( entry.token.IsCancellationRequested() )
+	{
+#ifndef SHIPPING
+		m_metrics.OnDropped( GetPriorityBand( entry.priority ), entry.enqueueTime );
+#endif
+		Detail::DropTask( std::move( entry.task ) );
+		return;
+	}
+
+#ifndef SHIPPING
+	if ( entry.enqueueTime != 0 || m_metrics.IsEnabled() )
+	{
+		const size_t band = GetPriorityBand( entry.priority );
+		const uint64_t startTime = Detail::ThreadPoolMetrics::Now();
+		m_metrics.OnStarted( band, entry.enqueueTime, startTime );
+
+		InvokeTask( entry, workerIndex );
+
+		m_metrics.OnFinished( band, workerIndex, startTime, Detail::ThreadPoolMetrics::Now() );
+		return;
+	}
+#endif
+
+	InvokeTask( entry, workerIndex );
+}
+
+void ThreadPool::InvokeTask( Entry& entry, size_t workerIndex )
+{
+	if ( !m_fiberOptions )
+	{
+		entry.task();
+		return;
+	}
+
+	Detail::Fiber* fiber = nullptr;
+	auto& freeFibers = m_freeFibers[ workerIndex ];
+	if ( !freeFibers.empty() )
+	{
+		fiber = freeFibers.back();
+		freeFibers.pop_back();
+	}
+	else
+	{
+		fiber = Detail::Fiber::Create( m_fiberOptions->stackSize, this );
+		if ( fiber == nullptr )
+		{
+			entry.task();
+			return;
+		}
+	}
+
+	fiber->SetTask( std::move( entry.task ), entry.priority );
+	++m_activeFibers;
+	ResumeFiber( fiber, workerIndex );
+}
+
+void ThreadPool::ResumeFiber( Detail::Fiber* fiber, size_t workerIndex )
+{
+	if ( fiber->Resume() )
+	{
+		auto& freeFibers = m_freeFibers[ workerIndex ];
+		if ( freeFibers.size() < m_fiberOptions->maxPooledFibers )
+			freeFibers.push_back( fiber );
+		else
+			delete fiber;
+
+		if ( --m_activeFibers == 0 )
+		{
+			// a stopping pool may have workers waiting for the last fiber
+			std::lock_guard lock( m_mutex );
+			if ( m_signal == Signal::Stop )
+				m_condition.notify_all();
+		}
+		return;
+	}
+
+	// the fiber has switched out, so it can be handed to a waker. Once parked it must not be touched here
+	if ( !Detail::AtomicPark( *fiber->GetParkValue(), fiber->GetParkOld(), &WakeFiber, fiber ) )
+		QueueFiber( fiber );
+}
+
+void ThreadPool::QueueFiber( Detail::Fiber* fiber )
+{
+	{
+		std::lock_guard lock( m_mutex );
+		m_taskQueue.Push( GetPriorityBand( fiber->GetPriority() ), Entry( fiber, fiber->GetPriority() ) );
+		++m_sharedTasks;
+		++m_pendingTasks;
+	}
+
+	m_condition.notify_one();
+
+	if ( m_isElastic )
+		WakeMonitor();
+}
+
+void ThreadPool::WakeFiber( void* fiber )
+{
+	auto* f = static_cast<Detail::Fiber*>( fiber );
+	static_cast<ThreadPool*>( f->GetUserData() )->QueueFiber( f );
+}
+
+void ThreadPool::WakeWorkers( size_t count )
+{
+	const size_t sleeping = m_sleepingWorkers;
+	if ( sleeping > 0 )
+	{
+		// synchronize with a worker that is between checking its predicate and sleeping
+		std::lock_guard lock( m_mutex );
+	}
+
+	if ( count > 1 && count >= sleeping )
+	{
+		m_condition.notify_all();
+		return;
+	}
+
+	for ( size_t i = 0; i < count; ++i )
+		m_condition.notify_one();
+}
+
+void ThreadPool::JoinWithSignal( Signal s )
+{
+	dbAssert( s != Signal::Run );
+
+	{
+		std::lock_guard lock( m_mutex );
+		m_signal = s;
+	}
+
+	m_condition.notify_all();
+
+	// the monitor may be starting a worker, so it has to be gone before the workers are joined
+	m_monitorCondition.notify_all();
+	if ( m_monitor.joinable() )
+		m_monitor.join();
+
+	for ( auto& t : m_threads )
+	{
+		if ( t.joinable() )
+			t.join();
+	}
+}
+
+#ifndef SHIPPING
+void ThreadPool::DumpMetrics( const char* filename ) const
+{
+	std::ofstream fout( filename );
+	GetMetrics().Log( fout );
+}
+#endif
+
+ThreadPool StaticThreadPool( std::thread::hardware_concurrency(), SchedulingMode::WorkStealing );
+
+} // namespace Threading
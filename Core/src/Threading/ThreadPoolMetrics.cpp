@@ -0,0 +1,166 @@
+#ifndef SHIPPING
+
+#include "Threading/ThreadPoolMetrics.h"
+
+#include "Threading/ThreadPool.h"
+
+#include <iomanip>
+
+namespace Threading
+{
+
+namespace
+{
+	constexpr double NanoSecondsPerMicrosecond = 1000.0;
+
+	void LogHistogram( std::ostream& out, const char* label, const HistogramSnapshot& histogram )
+	{
+		if ( histogram.count == 0 )
+			return;
+
+		out << "\t\t" << label
+			<< ": count " << histogram.count
+			<< ", mean " << histogram.GetMeanNanoseconds() / NanoSecondsPerMicrosecond << "us"
+			<< ", p50 " << histogram.GetPercentileNanoseconds( 50 ) / NanoSecondsPerMicrosecond << "us"
+			<< ", p99 " << histogram.GetPercentileNanoseconds( 99 ) / NanoSecondsPerMicrosecond << "us"
+			<< ", max " << histogram.maxNanoseconds / NanoSecondsPerMicrosecond << "us\n";
+	}
+}
+
+static_assert( ThreadPoolMetricsSnapshot::BandCount == PriorityBandCount );
+
+uint64_t HistogramSnapshot::GetPercentileNanoseconds( double percentile ) const noexcept
+{
+	if ( count == 0 )
+		return 0;
+
+	const auto target = static_cast<uint64_t>( std::clamp( percentile, 0.0, 100.0 ) / 100.0 * static_cast<double>( count ) );
+	uint64_t seen = 0;
+	for ( size_t i = 0; i < BucketCount; ++i )
+	{
+		seen += buckets[ i ];
+		if ( seen > target || seen == count )
+			return std::min( ( uint64_t( 2 ) << i ) - 1, maxNanoseconds );
+	}
+	return maxNanoseconds;
+}
+
+void ThreadPoolMetricsSnapshot::Log( std::ostream& out ) const
+{
+	out << "thread pool metrics over " << elapsedNanoseconds / 1000000000.0 << "s\n";
+
+	out << "\tpriority bands:\n";
+	for ( size_t band = 0; band < BandCount; ++band )
+	{
+		if ( queueDepth[ band ] == 0 && queueLatency[ band ].count == 0 && runTime[ band ].count == 0 )
+			continue;
+
+		out << "\t  band " << band << " (priority " << static_cast<int>( PriorityBands[ band ] ) << "), queued " << queueDepth[ band ] << '\n';
+		LogHistogram( out, "queue latency", queueLatency[ band ] );
+		LogHistogram( out, "run time", runTime[ band ] );
+	}
+
+	out << "\tworkers:\n";
+	for ( size_t i = 0; i < workers.size(); ++i )
+	{
+		const auto& worker = workers[ i ];
+		out << "\t  worker " << i
+			<< ": tasks " << worker.tasksRun
+			<< ", steals " << worker.steals
+			<< ", busy " << std::fixed << std::setprecision( 1 ) << worker.utilization * 100.0 << '%'
+			<< std::defaultfloat << std::setprecision( 6 ) << '\n';
+	}
+
+	out << '\n';
+}
+
+namespace Detail
+{
+
+HistogramSnapshot LatencyHistogram::Snapshot() const noexcept
+{
+	HistogramSnapshot snapshot;
+	for ( size_t i = 0; i < HistogramSnapshot::BucketCount; ++i )
+		snapshot.buckets[ i ] = m_buckets[ i ].load( std::memory_order_relaxed );
+
+	snapshot.count = m_count.load( std::memory_order_relaxed );
+	snapshot.totalNanoseconds = m_total.load( std::memory_order_relaxed );
+	snapshot.maxNanoseconds = m_max.load( std::memory_order_relaxed );
+	return snapshot;
+}
+
+void LatencyHistogram::Reset() noexcept
+{
+	for ( auto& bucket : m_buckets )
+		bucket.store( 0, std::memory_order_relaxed );
+
+	m_count.store( 0, std::memory_order_relaxed );
+	m_total.store( 0, std::memory_order_relaxed );
+	m_max.store( 0, std::memory_order_relaxed );
+}
+
+ThreadPoolMetrics::ThreadPoolMetrics( size_t workerCount )
+	: m_workers( std::make_unique<WorkerCounters[]>( workerCount ) )
+	, m_workerCount( workerCount )
+{}
+
+void ThreadPoolMetrics::Enable( bool enable ) noexcept
+{
+	if ( enable && !m_enabled.load( std::memory_order_relaxed ) )
+		Reset();
+
+	m_enabled.store( enable, std::memory_order_relaxed );
+}
+
+void ThreadPoolMetrics::Reset() noexcept
+{
+	for ( auto& histogram : m_queueLatency )
+		histogram.Reset();
+
+	for ( auto& histogram : m_runTime )
+		histogram.Reset();
+
+	for ( size_t i = 0; i < m_workerCount; ++i )
+	{
+		m_workers[ i ].tasksRun.store( 0, std::memory_order_relaxed );
+		m_workers[ i ].steals.store( 0, std::memory_order_relaxed );
+		m_workers[ i ].busyNanoseconds.store( 0, std::memory_order_relaxed );
+	}
+
+	m_startTime.store( Now(), std::memory_order_relaxed );
+}
+
+ThreadPoolMetricsSnapshot ThreadPoolMetrics::Snapshot() const
+{
+	ThreadPoolMetricsSnapshot snapshot;
+
+	for ( size_t band = 0; band < ThreadPoolMetricsSnapshot::BandCount; ++band )
+	{
+		snapshot.queueDepth[ band ] = static_cast<uint64_t>( std::max<int64_t>( m_queueDepth[ band ].load( std::memory_order_relaxed ), 0 ) );
+		snapshot.queueLatency[ band ] = m_queueLatency[ band ].Snapshot();
+		snapshot.runTime[ band ] = m_runTime[ band ].Snapshot();
+	}
+
+	const uint64_t startTime = m_startTime.load( std::memory_order_relaxed );
+	snapshot.elapsedNanoseconds = startTime ? Now() - startTime : 0;
+
+	snapshot.workers.resize( m_workerCount );
+	for ( size_t i = 0; i < m_workerCount; ++i )
+	{
+		auto& worker = snapshot.workers[ i ];
+		worker.tasksRun = m_workers[ i ].tasksRun.load( std::memory_order_relaxed );
+		worker.steals = m_workers[ i ].steals.load( std::memory_order_relaxed );
+		worker.busyNanoseconds = m_workers[ i ].busyNanoseconds.load( std::memory_order_relaxed );
+
+		if ( snapshot.elapsedNanoseconds > 0 )
+			worker.utilization = std::min( 1.0, static_cast<double>( worker.busyNanoseconds ) / snapshot.elapsedNanoseconds );
+	}
+
+	return snapshot;
+}
+
+} // namespace Detail
+
+} // namespace Threading
+
+#endif
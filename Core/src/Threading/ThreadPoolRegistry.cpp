@@ -0,0 +1,126 @@
+#include "Threading/ThreadPoolRegistry.h"
+
+#include <algorithm>
+
+namespace Threading
+{
+
+std::string_view GetStandardPoolName( StandardPool pool ) noexcept
+{
+	switch ( pool )
+	{
+		case StandardPool::Compute:		return "Compute";
+		case StandardPool::IO:			return "IO";
+		case StandardPool::Background:	return "Background";
+	}
+
+	dbBreak();
+	return {};
+}
+
+ThreadPoolRegistry::ThreadPoolRegistry()
+{
+	m_pools.push_back( NamedPool{ std::string( GetStandardPoolName( StandardPool::Compute ) ), &StaticThreadPool, nullptr } );
+}
+
+bool ThreadPoolRegistry::Configure( ThreadPoolConfig config )
+{
+	std::lock_guard lock( m_mutex );
+
+	if ( auto* existing = FindNamedPool( config.name ) )
+	{
+		if ( existing->ownedPool == nullptr && ( !config.cpus.empty() || config.numaNode ) )
+		{
+			dbLogWarning( "thread pool [%s] already exists. Only its affinity was configured", config.name.c_str() );
+			ApplyAffinity( *existing->pool, config );
+		}
+		else
+		{
+			dbLogWarning( "thread pool [%s] already exists. Configuration ignored", config.name.c_str() );
+		}
+		return false;
+	}
+
+	auto it = std::find_if( m_configs.begin(), m_configs.end(), [ &config ]( auto& c ) { return c.name == config.name; } );
+	if ( it != m_configs.end() )
+		*it = std::move( config );
+	else
+		m_configs.push_back( std::move( config ) );
+
+	return true;
+}
+
+ThreadPool& ThreadPoolRegistry::GetPool( std::string_view name )
+{
+	std::lock_guard lock( m_mutex );
+
+	if ( auto* existing = FindNamedPool( name ) )
+		return *existing->pool;
+
+	auto it = std::find_if( m_configs.begin(), m_configs.end(), [ name ]( auto& c ) { return c.name == name; } );
+	const ThreadPoolConfig config = ( it != m_configs.end() ) ? *it : GetDefaultConfig( name );
+
+	dbLog( "creating thread pool [%s] with %zu threads", config.name.c_str(), config.threadCount );
+	auto pool = config.elastic
+		? std::make_unique<ThreadPool>( *config.elastic, config.mode, config.fibers )
+		: std::make_unique<ThreadPool>( config.threadCount, config.mode, config.fibers );
+	ApplyAffinity( *pool, config );
+
+	auto& entry = m_pools.emplace_back( NamedPool{ config.name, pool.get(), std::move( pool ) } );
+	return *entry.pool;
+}
+
+ThreadPool* ThreadPoolRegistry::FindPool( std::string_view name )
+{
+	std::lock_guard lock( m_mutex );
+	auto* existing = FindNamedPool( name );
+	return existing ? existing->pool : nullptr;
+}
+
+ThreadPoolConfig ThreadPoolRegistry::GetDefaultConfig( std::string_view name )
+{
+	ThreadPoolConfig config;
+	config.name = std::string( name );
+
+	if ( name == GetStandardPoolName( StandardPool::IO ) )
+	{
+		// mostly blocked in the OS, so a fixed handful of threads keeps reads in flight regardless of the core count
+		config.threadCount = 4;
+	}
+	else if ( name == GetStandardPoolName( StandardPool::Background ) )
+	{
+		config.threadCount = 1;
+	}
+
+	return config;
+}
+
+void ThreadPoolRegistry::ApplyAffinity( ThreadPool& pool, const ThreadPoolConfig& config )
+{
+	CpuSet cpus = config.cpus;
+	if ( config.numaNode )
+	{
+		const CpuSet nodeCpus = GetNumaNodeCpus( *config.numaNode );
+		if ( nodeCpus.empty() )
+			dbLogWarning( "NUMA node %u not found for thread pool [%s]", *config.numaNode, config.name.c_str() );
+
+		cpus.insert( cpus.end(), nodeCpus.begin(), nodeCpus.end() );
+	}
+
+	if ( cpus.empty() )
+		return;
+
+	std::sort( cpus.begin(), cpus.end() );
+	cpus.erase( std::unique( cpus.begin(), cpus.end() ), cpus.end() );
+
+	if ( !pool.SetAffinity( cpus, config.pinEachWorker ) )
+		dbLogWarning( "could not set affinity of thread pool [%s]", config.name.c_str() );
+}
+
+ThreadPoolRegistry::NamedPool* ThreadPoolRegistry::FindNamedPool( std::string_view name )
+{
+	auto it = std::find_if( m_pools.begin(), m_pools.end(), [ name ]( auto& p ) { return p.name == name; } );
+	return it != m_pools.end() ? &*it : nullptr;
+}
+
+} // namespace Threading
@@ -0,0 +1,332 @@
+#include "Threading/TimerWheel.h"
+
+#include <stdx/bit.h>
+
+#include <algorithm>
+
+namespace Threading
+{
+
+TimerWheel::TimerWheel( Duration resolution )
+	: m_resolution( resolution )
+	, m_epoch( Clock::now() )
+{
+	dbAssert( resolution > Duration::zero() );
+	m_thread = std::thread( [ this ] { Run(); } );
+}
+
+TimerWheel::~TimerWheel()
+{
+	{
+		std::lock_guard lock( m_mutex );
+		m_stop = true;
+	}
+	m_condition.notify_one();
+	m_thread.join();
+
+	std::vector<Callback> cancelled;
+	{
+		std::lock_guard lock( m_mutex );
+		for ( auto& node : m_nodes )
+		{
+			if ( node.list )
+			{
+				Unlink( node );
+				cancelled.push_back( std::move( node.onCancel ) );
+				Release( node );
+			}
+		}
+	}
+
+	for ( auto& onCancel : cancelled )
+		onCancel();
+}
+
+bool TimerWheel::Cancel( TimerId timer )
+{
+	Callback onFire;
+	std::shared_ptr<Callback> onPeriodicFire;
+	Callback onCancel;
+
+	{
+		std::lock_guard lock( m_mutex );
+		if ( timer.index >= m_nodes.size() )
+			return false;
+
+		auto& node = m_nodes[ timer.index ];
+		if ( node.generation != timer.generation || node.list == nullptr )
+			return false;
+
+		Unlink( node );
+
+		// callbacks may own promises, so they are destroyed outside the lock
+		onFire = std::move( node.onFire );
+		onPeriodicFire = std::move( node.onPeriodicFire );
+		onCancel = std::move( node.onCancel );
+		Release( node );
+	}
+
+	if ( onCancel )
+		onCancel();
+
+	return true;
+}
+
+size_t TimerWheel::GetPendingCount() const
+{
+	std::lock_guard lock( m_mutex );
+	return m_pendingCount;
+}
+
+TimerId TimerWheel::InsertLocked( uint64_t deadline, uint64_t period, Callback onFire, std::shared_ptr<Callback> onPeriodicFire, Callback onCancel )
+{
+	uint32_t index;
+	if ( m_freeNodes.empty() )
+	{
+		index = static_cast<uint32_t>( m_nodes.size() );
+		m_nodes.emplace_back();
+		m_nodes.back().index = index;
+	}
+	else
+	{
+		index = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+
+	auto& node = m_nodes[ index ];
+	node.deadline = std::max( deadline, m_currentTick + 1 );
+	node.period = period;
+	node.onFire = std::move( onFire );
+	node.onPeriodicFire = std::move( onPeriodicFire );
+	node.onCancel = std::move( onCancel );
+
+	Link( node );
+	++m_pendingCount;
+
+	if ( node.deadline < m_wakeTick )
+		m_condition.notify_one();
+
+	return TimerId{ index, node.generation };
+}
+
+uint64_t TimerWheel::ToTick( TimePoint time ) const noexcept
+{
+	return time <= m_epoch ? 0 : ToTicks( time - m_epoch );
+}
+
+uint64_t TimerWheel::ToTicks( Duration duration ) const noexcept
+{
+	// rounded up so a timer never fires early
+	if ( duration <= Duration::zero() )
+		return 0;
+
+	return static_cast<uint64_t>( ( duration.count() + m_resolution.count() - 1 ) / m_resolution.count() );
+}
+
+void TimerWheel::Link( Node& node )
+{
+	dbAssert( node.deadline >= m_currentTick );
+
+	// the level is the highest byte in which the deadline differs from the current tick
+	const uint64_t diff = node.deadline ^ m_currentTick;
+
+	List* list = &m_overflow;
+	for ( uint32_t level = 0; level < LevelCount; ++level )
+	{
+		if ( diff < ( uint64_t( 1 ) << ( LevelBits * ( level + 1 ) ) ) )
+		{
+			const auto slot = static_cast<uint32_t>( ( node.deadline >> ( LevelBits * level ) ) & SlotMask );
+			list = &m_wheel[ level ][ slot ];
+
+			if ( level == 0 )
+				m_occupiedSlots[ slot / 64 ] |= uint64_t( 1 ) << ( slot % 64 );
+
+			break;
+		}
+	}
+
+	node.prev = nullptr;
+	node.next = list->head;
+	if ( list->head )
+		list->head->prev = &node;
+
+	list->head = &node;
+	node.list = list;
+}
+
+void TimerWheel::Unlink( Node& node )
+{
+	dbAssert( node.list );
+
+	if ( node.prev )
+		node.prev->next = node.next;
+	else
+		node.list->head = node.next;
+
+	if ( node.next )
+		node.next->prev = node.prev;
+
+	if ( node.list->head == nullptr )
+	{
+		const auto offset = node.list - m_wheel[ 0 ].data();
+		if ( offset >= 0 && offset < SlotCount )
+			m_occupiedSlots[ offset / 64 ] &= ~( uint64_t( 1 ) << ( offset % 64 ) );
+	}
+
+	node.prev = nullptr;
+	node.next = nullptr;
+	node.list = nullptr;
+}
+
+void TimerWheel::Release( Node& node )
+{
+	dbAssert( node.list == nullptr );
+
+	node.onFire = nullptr;
+	node.onPeriodicFire = nullptr;
+	node.onCancel = nullptr;
+
+	// invalidates outstanding ids
+	++node.generation;
+
+	m_freeNodes.push_back( node.index );
+	--m_pendingCount;
+}
+
+uint32_t TimerWheel::FindOccupiedSlot( uint32_t first ) const noexcept
+{
+	for ( uint32_t word = first / 64; word < m_occupiedSlots.size(); ++word )
+	{
+		uint64_t bits = m_occupiedSlots[ word ];
+		if ( word == first / 64 )
+			bits &= ~uint64_t( 0 ) << ( first % 64 );
+
+		if ( bits )
+			return word * 64 + static_cast<uint32_t>( stdx::countr_zero( bits ) );
+	}
+
+	return SlotCount;
+}
+
+void TimerWheel::Cascade( uint32_t level )
+{
+	auto& list = m_wheel[ level ][ ( m_currentTick >> ( LevelBits * level ) ) & SlotMask ];
+
+	Node* node = std::exchange( list.head, nullptr );
+	while ( node )
+	{
+		Node* next = node->next;
+		Link( *node );
+		node = next;
+	}
+}
+
+void TimerWheel::ProcessTick( uint64_t tick )
+{
+	m_currentTick = tick;
+
+	if ( ( tick & SlotMask ) == 0 )
+	{
+		if ( ( tick & 0xffffffff ) == 0 )
+		{
+			Node* node = std::exchange( m_overflow.head, nullptr );
+			while ( node )
+			{
+				Node* next = node->next;
+				Link( *node );
+				node = next;
+			}
+		}
+
+		for ( uint32_t level = LevelCount - 1; level > 0; --level )
+		{
+			if ( ( tick & ( ( uint64_t( 1 ) << ( LevelBits * level ) ) - 1 ) ) == 0 )
+				Cascade( level );
+		}
+	}
+
+	// every node in the current level 0 slot is due now
+	auto& list = m_wheel[ 0 ][ tick & SlotMask ];
+	while ( Node* node = list.head )
+	{
+		Unlink( *node );
+
+		if ( node->period != 0 )
+		{
+			m_fired.push_back( [ callback = node->onPeriodicFire ] { ( *callback )(); } );
+			node->deadline += node->period;
+			Link( *node );
+		}
+		else
+		{
+			m_fired.push_back( std::move( node->onFire ) );
+			Release( *node );
+		}
+	}
+}
+
+void TimerWheel::Advance( uint64_t targetTick )
+{
+	while ( m_currentTick < targetTick )
+	{
+		// skip straight to the next occupied slot, or to the next block where higher levels cascade
+		const uint32_t slot = FindOccupiedSlot( static_cast<uint32_t>( m_currentTick & SlotMask ) + 1 );
+		const uint64_t blockStart = m_currentTick & ~uint64_t( SlotMask );
+		const uint64_t next = ( slot < SlotCount ) ? blockStart + slot : blockStart + SlotCount;
+
+		if ( next > targetTick )
+		{
+			m_currentTick = targetTick;
+			return;
+		}
+
+		ProcessTick( next );
+	}
+}
+
+uint64_t TimerWheel::GetNextEventTick() const noexcept
+{
+	const uint32_t slot = FindOccupiedSlot( static_cast<uint32_t>( m_currentTick & SlotMask ) + 1 );
+	const uint64_t blockStart = m_currentTick & ~uint64_t( SlotMask );
+	return ( slot < SlotCount ) ? blockStart + slot : blockStart + SlotCount;
+}
+
+void TimerWheel::Run()
+{
+	std::vector<Callback> fired;
+
+	std::unique_lock lock( m_mutex );
+	while ( !m_stop )
+	{
+		Advance( ToTick( Clock::now() ) );
+
+		if ( !m_fired.empty() )
+		{
+			// reuse both buffers so firing does not allocate
+			std::swap( fired, m_fired );
+			lock.unlock();
+
+			for ( auto& callback : fired )
+				callback();
+
+			fired.clear();
+			lock.lock();
+			continue;
+		}
+
+		if ( m_pendingCount == 0 )
+		{
+			m_wakeTick = std::numeric_limits<uint64_t>::max();
+			m_condition.wait( lock );
+		}
+		else
+		{
+			m_wakeTick = GetNextEventTick();
+			m_condition.wait_until( lock, m_epoch + m_resolution * static_cast<Duration::rep>( m_wakeTick ) );
+		}
+
+		m_wakeTick = 0;
+	}
+}
+
+} // namespace Threading
@@ -0,0 +1,22 @@
+#include <Inventory/InventoryPack.h>
+
+#include <iostream>
+
+int main( int argc, char** argv )
+{
+	if ( argc < 3 || argc > 4 )
+	{
+		std::cout << "usage: InventoryPacker <directory> <pack> [prefix]\n";
+		std::cout << "items are named prefix + their path relative to directory, e.g. data/textures/grass.png\n";
+		return -1;
+	}
+
+	const char* prefix = argc == 4 ? argv[ 3 ] : "";
+	if ( !BuildInventoryPack( argv[ 1 ], argv[ 2 ], prefix ) )
+	{
+		std::cout << "Error: could not pack " << argv[ 1 ] << " into " << argv[ 2 ] << '\n';
+		return -1;
+	}
+
+	return 0;
+}